@@ -0,0 +1,107 @@
+#pragma once
+
+//! C++20 coroutine API for the decomp2dbg XML-RPC API.
+//! Built as the separate clientCoro library, as the plugin itself has to stay on C++17.
+//! Calls are awaited rather than blocked on, so multi-step fetches read like straight-line code:
+//!
+//!     Task<std::size_t> sourceLines(AsyncClient& c, std::size_t addr) {
+//!         const FunctionData data = co_await c.queryFunctionData(addr);
+//!         const DecompiledFunction f = co_await c.queryDecompiledFunction(addr);
+//!         co_return f.source.size();
+//!     }
+//!
+//! and any number of them can be kept in flight at once on a single thread through whenAll().
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <xmlrpc-c/base.hpp>
+
+#include "cancellation.h"
+#include "client.h"
+#include "task.h"
+#include "transport.h"
+
+class Metrics;
+class StreamDecoder;
+
+/// Client for the decomp2dbg XML-RPC API, with every call returning a Task to be awaited.
+/// Decodes responses into the same types as Client does, and goes through the same transports,
+/// started with Transport::startRoundTrip() so no coroutine ever blocks on one.
+/// Tasks refer to the client they came from, so it must outlive them.
+/// Not thread-safe: create one per thread, and drive it with run() on that thread.
+class AsyncClient {
+   public:
+    AsyncClient() = delete;
+    /// Talk to the server at the given URL over HTTP, failing fast while it's down, like Client does.
+    explicit AsyncClient(const std::string& endpoint_url);
+    /// Talk to the server through the given transport.
+    explicit AsyncClient(std::shared_ptr<Transport> transport);
+    AsyncClient(const AsyncClient&) = delete;
+    AsyncClient& operator=(const AsyncClient&) = delete;
+    ~AsyncClient();
+
+    /// Run the event loop until `task` is done, returning its result.
+    /// All coroutines awaiting calls of this client run on the calling thread in the meantime.
+    /// `task` must only ever wait for calls of this client, or the loop waits forever.
+    template <typename T>
+    T run(Task<T> task) {
+        task.start();
+        while (!task.done()) {
+            step();
+        }
+        return task.result();
+    }
+    /// Traffic statistics of the underlying transport.
+    WireStats wireStats() const;
+    /// Snapshot of per-method call metrics, in the same shape as Client's.
+    std::vector<MethodMetrics> metrics() const;
+    /// Human-readable table of per-method call metrics.
+    std::string dumpMetrics() const;
+
+    /// Ping the server to check whether the connection works, and find out whether it takes compressed requests.
+    Task<void> ping(CallOptions opts = CallOptions());
+    /// Query basic information about all functions known to the decompiler.
+    /// Decoded while it arrives, as the response is about as big as they get.
+    Task<std::vector<Symbol>> queryFunctionHeaders(CallOptions opts = CallOptions());
+    /// Query global variables. Decoded while it arrives, like queryFunctionHeaders().
+    Task<std::vector<Symbol>> queryGlobalVars(CallOptions opts = CallOptions());
+    /// Query a detailed decompilation of a function containing the given
+    /// module base-relative address.
+    Task<DecompiledFunction> queryDecompiledFunction(std::size_t addr, CallOptions opts = CallOptions());
+    /// Query detailed information about a function containing the given address.
+    Task<FunctionData> queryFunctionData(std::size_t addr, CallOptions opts = CallOptions());
+
+   private:
+    struct Exchange;
+    class RoundTrip;
+    /// Round trips done on the transport's threads, waiting for run() to resume their coroutines.
+    struct Inbox {
+        std::mutex lock;
+        std::condition_variable wake;
+        std::deque<std::function<void()>> ready;
+    };
+
+    /// Send a serialized request, handing the response to `onData` on the transport's thread as it arrives.
+    /// `onData` must only refer to what it keeps alive itself, as the awaiting coroutine may be gone by then.
+    RoundTrip roundTrip(std::string method, std::string request, Transport::DataSink onData, CallOptions opts);
+    /// Perform a single RPC, throwing on transport errors and faults.
+    Task<xmlrpc_c::value> call(std::string method, xmlrpc_c::paramList params, CallOptions opts);
+    /// Perform a parameterless RPC, with `decoder` decoding the response while it arrives.
+    Task<void> callStreaming(std::string method, std::shared_ptr<StreamDecoder> decoder, CallOptions opts);
+    template <typename F>
+    auto timeDecode(const std::string& method, F&& fn);
+    /// Wait for a round trip to be done, then resume whatever awaits it.
+    void step();
+
+    std::shared_ptr<Transport> m_transport;
+    // Shared with round trips in flight, which may outlive the client
+    std::shared_ptr<Inbox> m_inbox;
+    std::shared_ptr<Metrics> m_metrics;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+//! Spreading calls over several equivalent decompiler servers.
+//! Decompiling a big function can take a server seconds, during which it can't answer anything else,
+//! so having more than one server with the same program loaded cuts down on waiting.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "transport.h"
+
+/// Calls sent to one endpoint of a BalancingTransport.
+struct EndpointStats {
+    std::uint64_t calls;
+    std::uint64_t outstanding;
+};
+
+class WorkerPool;
+
+/// Sends every call to whichever of several equivalent endpoints has the fewest calls outstanding.
+/// Optionally hedges calls asking for it through CallOptions::hedge: if the answer takes longer than a threshold,
+/// the same call is also sent to a second endpoint and whichever answers first wins, the other is cancelled.
+/// Hedged responses are buffered until the winner is known, rather than handed out piece by piece,
+/// all other responses are streamed straight through.
+class BalancingTransport : public Transport {
+   public:
+    BalancingTransport() = delete;
+    /// Throws if no endpoints are given.
+    explicit BalancingTransport(std::vector<std::shared_ptr<Transport>> endpoints,
+                                std::optional<std::chrono::milliseconds> hedgeAfter = std::nullopt);
+    BalancingTransport(const BalancingTransport&) = delete;
+    BalancingTransport& operator=(const BalancingTransport&) = delete;
+    /// Waits for hedges still in flight.
+    ~BalancingTransport() override;
+
+    void roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) override;
+    /// Summed over all endpoints.
+    WireStats wireStats() const override;
+    void compressRequests() override;
+    /// Available as long as any endpoint is.
+    bool available() const override;
+    /// Per endpoint, in the order they were given.
+    std::vector<EndpointStats> endpointStats() const;
+    /// Number of calls sent to a second endpoint because the first was too slow.
+    std::uint64_t hedgedCalls() const;
+    /// Number of hedged calls the second endpoint answered first.
+    std::uint64_t hedgeWins() const;
+
+   private:
+    struct Race;
+    struct Endpoint {
+        std::shared_ptr<Transport> transport;
+        std::atomic<std::uint64_t> calls{0};
+        std::atomic<std::uint64_t> outstanding{0};
+    };
+
+    /// Pick the endpoint with the fewest calls outstanding, other than `exclude`, and count a call on it.
+    /// Endpoints that are available always win over ones that aren't.
+    /// Ties are broken round-robin, so idle endpoints all get their share.
+    Endpoint& acquire(const Endpoint* exclude);
+    void hedgedRoundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts);
+
+    std::vector<std::unique_ptr<Endpoint>> m_endpoints;
+    std::optional<std::chrono::milliseconds> m_hedgeAfter;
+    std::atomic<std::size_t> m_next;
+    std::atomic<std::uint64_t> m_hedged;
+    std::atomic<std::uint64_t> m_hedgeWins;
+    /// Waits out the hedging threshold and sends hedges, so calls don't need a thread of their own for that.
+    /// Declared last, so hedges still queued are done with before the endpoints go away.
+    std::unique_ptr<WorkerPool> m_hedgers;
+};
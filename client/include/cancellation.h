@@ -0,0 +1,78 @@
+#pragma once
+
+//! Deadlines and cancellation for client calls.
+//! Calls check for both before starting and keep watching while they're in flight,
+//! so work whose result is no longer wanted gets dropped as early as possible.
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Thrown when a call is abandoned because it was cancelled or ran past its deadline.
+class CancelledError : public std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+};
+
+/// Shared flag for cancelling calls from another thread.
+/// Copies refer to the same flag, so a token can be handed to any number of calls and cancelled once for all of them.
+class CancellationToken {
+   public:
+    CancellationToken();
+
+    /// Cancel all calls holding this token. Cancelling more than once has no further effect.
+    void cancel() const;
+    bool cancelled() const;
+    /// Run `fn` once the token is cancelled, right away if it already is.
+    /// `fn` is run with an internal lock held, so it must be quick and must not touch this token.
+    /// Returns an id for unsubscribe().
+    std::size_t subscribe(std::function<void()> fn) const;
+    /// Once this returns, the callback is guaranteed not to run anymore.
+    void unsubscribe(std::size_t id) const;
+
+   private:
+    struct State;
+    std::shared_ptr<State> m_state;
+};
+
+/// Limits on a single call. By default a call may take as long as it takes.
+struct CallOptions {
+    using Clock = std::chrono::steady_clock;
+
+    /// Abandon the call once this point in time has passed.
+    std::optional<Clock::time_point> deadline;
+    /// Abandon the call as soon as any of these is cancelled.
+    std::vector<CancellationToken> tokens;
+    /// Whether the call may also be sent to a second server when the first is slow to answer, see BalancingTransport.
+    /// Only meant for calls that are safe to make twice and have small responses, i.e. decompilations.
+    bool hedge = false;
+
+    /// Options for a call that may take at most `timeout` from now.
+    static CallOptions within(Clock::duration timeout);
+    /// Whether the call should be abandoned.
+    bool expired() const;
+    /// Throw CancelledError if the call should be abandoned.
+    void check() const;
+    /// Block until `until`, throwing CancelledError as soon as the call should be abandoned instead.
+    void sleepUntil(Clock::time_point until) const;
+};
+
+/// Runs a callback when any token of a call is cancelled, for as long as it is alive.
+/// Useful for waking up blocking waits, which can then check the call's options.
+class CancellationWatch {
+   public:
+    CancellationWatch() = delete;
+    CancellationWatch(const CallOptions& opts, std::function<void()> onCancel);
+    CancellationWatch(const CancellationWatch&) = delete;
+    CancellationWatch& operator=(const CancellationWatch&) = delete;
+    ~CancellationWatch();
+
+   private:
+    std::vector<std::pair<CancellationToken, std::size_t>> m_subscriptions;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+//! Recording client sessions to capture files and replaying them without a server.
+//! Captures make performance problems reproducible without access to the original decompiler project.
+//!
+//! A capture file starts with an 8 byte magic, followed by one record per exchange in the order they completed.
+//! Each record is a little endian u32 uncompressed size and u32 compressed size, followed by an lz4 block holding
+//! the u64 start offset and u64 duration of the exchange in nanoseconds, then the u32 length prefixed request,
+//! response and error. Captures from before errors were recorded, with the magic ending in 01, lack the error.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "transport.h"
+
+/// A single request/response pair of a recorded session.
+struct Exchange {
+    std::chrono::nanoseconds start;  // Since the recording started
+    std::chrono::nanoseconds duration;
+    std::string request;
+    /// As much of it as was received, if the exchange failed.
+    std::string response;
+    /// Why the exchange failed, empty if it succeeded.
+    std::string error;
+};
+
+/// Passes all calls on to another transport, appending every exchange to a capture file, failed ones included.
+class RecordingTransport : public Transport {
+   public:
+    RecordingTransport() = delete;
+    /// Truncates `path` if it exists, throws if it can't be opened.
+    RecordingTransport(std::shared_ptr<Transport> inner, const std::string& path);
+    RecordingTransport(const RecordingTransport&) = delete;
+    RecordingTransport& operator=(const RecordingTransport&) = delete;
+
+    void roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) override;
+    WireStats wireStats() const override;
+    void compressRequests() override;
+
+   private:
+    void write(const Exchange& exchange);
+
+    std::shared_ptr<Transport> m_inner;
+    std::chrono::steady_clock::time_point m_epoch;
+    std::mutex m_fileLock;
+    std::ofstream m_file;
+};
+
+/// Answers calls from a capture file instead of a server.
+/// Requests are matched by content, so replay is deterministic regardless of the order calls are made in.
+/// A request made more often than during recording cycles through the responses recorded for it.
+class ReplayTransport : public Transport {
+   public:
+    enum class Pacing {
+        /// Hold every response back until as much time passed as the recorded exchange took.
+        AsRecorded,
+        /// Answer immediately.
+        AsFastAsPossible,
+    };
+
+    ReplayTransport() = delete;
+    /// Load the whole capture file, throwing if it can't be read or is malformed.
+    explicit ReplayTransport(const std::string& path, Pacing pacing = Pacing::AsFastAsPossible);
+
+    /// Throws if the request wasn't recorded, or with the recorded error after handing out whatever was received
+    /// if the recorded exchange failed.
+    void roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) override;
+    WireStats wireStats() const override;
+    /// All recorded exchanges, in the order they completed.
+    const std::vector<Exchange>& exchanges() const;
+
+   private:
+    Pacing m_pacing;
+    std::vector<Exchange> m_exchanges;
+    std::unordered_map<std::string, std::vector<std::size_t>> m_byRequest;
+    std::mutex m_cursorLock;
+    // Number of times each request was answered so far
+    std::unordered_map<std::string, std::size_t> m_cursors;
+    std::atomic<std::uint64_t> m_requestBytes;
+    std::atomic<std::uint64_t> m_responseBytes;
+};
+
+/// How an exchange went when replayed by replaySchedule().
+struct ReplayedExchange {
+    /// How long after its recorded start offset the exchange was actually sent.
+    std::chrono::nanoseconds lateness;
+    std::chrono::nanoseconds duration;
+    /// Why the exchange failed, empty if it succeeded.
+    std::string error;
+};
+
+/// Send the requests of `exchanges` over `transport` on the timeline they were recorded on: each at its start offset
+/// from now, concurrently with those still in flight, so the load the server sees is the recorded one.
+/// `onResponse` gets the index and complete response of every exchange that succeeded, from the thread it ran on.
+/// Returns how every exchange went, in the order of `exchanges`.
+std::vector<ReplayedExchange> replaySchedule(Transport& transport, const std::vector<Exchange>& exchanges,
+                                             const std::function<void(std::size_t, const std::string&)>& onResponse);
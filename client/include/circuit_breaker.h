@@ -0,0 +1,80 @@
+#pragma once
+
+//! Failing fast while the decompiler server is down.
+//! Without this, every call made while nobody is listening waits for a connect timeout,
+//! which adds up quickly when calls are made on every module load or breakpoint.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "cancellation.h"
+#include "transport.h"
+
+/// Thrown instead of attempting a call while the server is known to be down.
+class UnavailableError : public std::runtime_error {
+   public:
+    using std::runtime_error::runtime_error;
+};
+
+/// When a CircuitBreakerTransport gives up on a server, and how it checks whether it's back.
+struct BreakerOptions {
+    /// Consecutive failed calls after which the server is considered down.
+    unsigned failureThreshold = 2;
+    /// Wait before the first probe.
+    std::chrono::milliseconds initialBackoff = std::chrono::milliseconds(250);
+    /// Longest wait between probes.
+    std::chrono::milliseconds maxBackoff = std::chrono::seconds(15);
+    /// How long a single probe may take.
+    std::chrono::milliseconds probeTimeout = std::chrono::seconds(2);
+};
+
+/// Wraps a transport, and stops passing calls on to it once it failed a few times in a row without the server
+/// answering at all. From then on, calls fail with UnavailableError right away while a background probe checks
+/// whether the server came back, waiting twice as long after every failed probe.
+/// Once a probe gets an answer, calls are passed on again.
+class CircuitBreakerTransport : public Transport {
+   public:
+    CircuitBreakerTransport() = delete;
+    /// `probeRequest` is sent to check whether the server is back, any answer to it counts, even a fault.
+    CircuitBreakerTransport(std::shared_ptr<Transport> inner, std::string probeRequest,
+                            BreakerOptions options = BreakerOptions());
+    CircuitBreakerTransport(const CircuitBreakerTransport&) = delete;
+    CircuitBreakerTransport& operator=(const CircuitBreakerTransport&) = delete;
+    ~CircuitBreakerTransport() override;
+
+    /// Throws UnavailableError without touching the inner transport while the server is down.
+    void roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) override;
+    WireStats wireStats() const override;
+    void compressRequests() override;
+    /// False while the server is considered down.
+    bool available() const override;
+    /// Number of times the server was found to be down.
+    std::uint64_t trips() const;
+    /// Number of calls failed without being attempted.
+    std::uint64_t rejected() const;
+
+   private:
+    void recordFailure();
+    void probeLoop();
+
+    std::shared_ptr<Transport> m_inner;
+    std::string m_probeRequest;
+    BreakerOptions m_options;
+    mutable std::mutex m_lock;
+    std::condition_variable m_wake;
+    bool m_open;
+    unsigned m_failures;
+    std::chrono::milliseconds m_backoff;
+    CallOptions::Clock::time_point m_retryAt;
+    std::uint64_t m_trips;
+    std::uint64_t m_rejected;
+    bool m_stopping;
+    CancellationToken m_stop;
+    std::thread m_prober;
+};
@@ -1,12 +1,23 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 #include <xmlrpc-c/base.hpp>
-#include <xmlrpc-c/client_simple.hpp>
+
+#include "cancellation.h"
+#include "log.h"
+#include "transport.h"
 
 enum class SymbolType { Function, Other };
 
@@ -29,6 +40,16 @@ struct DecompiledFunction {
     int line_num;
 };
 
+/// Outcome of a single lookup in a batched decompile query.
+struct DecompileResult {
+    /// The module base-relative address that was queried.
+    std::size_t addr;
+    /// Set if the lookup succeeded.
+    std::optional<DecompiledFunction> function;
+    /// Why the lookup failed, if it did.
+    std::string error;
+};
+
 struct StackVar {
     std::string name;
     std::string type;
@@ -80,35 +101,211 @@ struct Enum {
 
 typedef std::variant<TypeAlias, Structure, Union, Enum> Type;
 
+/// What the server supports beyond the basic API, as discovered by the handshake in ping().
+struct ServerCapabilities {
+    /// The server's self-reported version, empty if it predates the handshake.
+    std::string version;
+    /// Protocol revision spoken by the server, 0 if it predates the handshake.
+    int protocol;
+    /// Understands system.multicall.
+    bool multicall;
+    /// Accepts gzip-compressed request bodies.
+    bool compressedRequests;
+    /// Offers d2d.decompile_many, decompiling many addresses in a single call.
+    bool bulkDecompile;
+    /// Offers d2d.revision, which changes whenever the decompiler's view of the binary does.
+    bool revisions;
+};
+
+/// How many calls were answered by sharing an identical call already in flight.
+struct CoalescingStats {
+    std::uint64_t calls;
+    std::uint64_t coalesced;
+};
+
+/// Statistics of all calls to one RPC method.
+/// Latency covers the round trip to the server, decoding the response is accounted separately.
+struct MethodMetrics {
+    std::string method;
+    std::uint64_t calls;
+    /// Calls failing in transport, with a fault, or while decoding.
+    std::uint64_t errors;
+    /// Sizes before compression.
+    std::uint64_t requestBytes;
+    std::uint64_t responseBytes;
+    std::chrono::nanoseconds p50;
+    std::chrono::nanoseconds p95;
+    std::chrono::nanoseconds p99;
+    /// Total time spent parsing and decoding responses.
+    /// Streamed responses are decoded while being received, so this includes time spent in their sinks.
+    std::chrono::nanoseconds decodeTime;
+};
+
+/// Thrown when the server answers a call with an XML-RPC fault.
+class FaultError : public std::runtime_error {
+   public:
+    FaultError(int code, const std::string& description);
+    int code() const;
+
+   private:
+    int m_code;
+};
+
+template <typename T>
+class SingleFlight;
+class Metrics;
+class StreamDecoder;
+class ValueView;
+class WorkerPool;
+
+/// HTTP to the given URL, failing fast while the server there is down.
+/// What a Client made from a URL talks over, for wrapping it in further transports.
+std::shared_ptr<Transport> guardedHttpTransport(const std::string& url);
+
+/// Client for the decomp2dbg XML-RPC API.
+/// Over HTTP, connections to the server are kept alive and reused across calls,
+/// so a single long-lived instance should be preferred over creating one per query.
+/// All methods are safe to call from multiple threads concurrently.
+/// The *Async methods run on a background worker pool, so many requests can be kept outstanding at once.
+/// Identical calls made concurrently, e.g. from stepping and GUI navigation at once, share a single round trip.
+/// Which of several ways to get something is fastest depends on what the server supports,
+/// so the client discovers that on ping() and picks the best path for every call from then on.
+/// Every call takes optional CallOptions with a deadline and cancellation tokens,
+/// once either hits the call throws CancelledError, whether it was still queued or already in flight.
 class Client {
    public:
     Client() = delete;
+    /// Talk to the server at the given URL over HTTP.
     Client(const char* endpoint_url);
-    /// Ping the server to check whether the connection works.
-    void ping();
-    /// Enable verbose logging.
+    /// Spread calls over several equivalent servers at the given URLs, which must have the same program loaded.
+    /// If `hedgeAfter` is set, calls taking longer than that are also sent to a second server, see
+    /// BalancingTransport.
+    explicit Client(const std::vector<std::string>& endpoint_urls,
+                    std::optional<std::chrono::milliseconds> hedgeAfter = std::nullopt);
+    /// Talk to a server over the given transport.
+    explicit Client(std::shared_ptr<Transport> transport);
+    Client(const Client&) = delete;
+    Client& operator=(const Client&) = delete;
+    ~Client();
+    /// Ping the server to check whether the connection works,
+    /// then (re)discover what the server supports and adapt to it.
+    void ping(const CallOptions& opts = CallOptions());
+    /// What the server supports, as discovered by the last ping().
+    /// Discovers it first if that hasn't happened yet.
+    ServerCapabilities capabilities(const CallOptions& opts = CallOptions());
+    /// Query the current revision of the decompiler's view of the binary.
+    /// Only supported if capabilities() lists revisions.
+    std::int64_t queryRevision(const CallOptions& opts = CallOptions());
+    /// Log everything, down to every line of decompiled source.
+    /// Shorthand for setLogLevel(LogLevel::Trace).
     void logVerbosely();
+    /// Only log messages of at least `level`. Defaults to warnings.
+    void setLogLevel(LogLevel level);
+    /// Send log messages to `sink` rather than stdout.
+    void setLogSink(Logger::Sink sink);
+    /// Traffic statistics of the underlying transport.
+    WireStats wireStats() const;
+    /// Whether the server is thought to be reachable. While it isn't, calls fail right away.
+    bool serverAvailable() const;
+    /// Counts of calls made and of those which shared another call's round trip.
+    CoalescingStats coalescingStats() const;
+    /// Per-method statistics of all calls made so far, ordered by method name.
+    std::vector<MethodMetrics> metrics() const;
+    /// metrics() as a human-readable table.
+    std::string dumpMetrics() const;
+    /// Cancel all calls currently queued or in flight, e.g. when the debuggee is gone.
+    /// Calls made afterwards are unaffected.
+    void cancelAll();
     /// Query basic information about all functions known to the decompiler.
-    std::vector<Symbol> queryFunctionHeaders();
+    std::vector<Symbol> queryFunctionHeaders(const CallOptions& opts = CallOptions());
+    /// Like queryFunctionHeaders(), but hands each function to `sink` as soon as it's been received,
+    /// without ever holding the full response or all functions in memory.
+    void forEachFunctionHeader(const std::function<void(const Symbol&)>& sink, const CallOptions& opts = CallOptions());
+    /// Like forEachFunctionHeader(), but hands functions to `sink` in pages of up to `pageSize`.
+    /// Only a single page is held in memory at a time.
+    void forEachFunctionHeader(std::size_t pageSize, const std::function<void(const std::vector<Symbol>&)>& sink,
+                               const CallOptions& opts = CallOptions());
     /// Query a detailed decompilation of a function containing the given
     /// module base-relative address.
-    DecompiledFunction queryDecompiledFunction(std::size_t addr);
+    DecompiledFunction queryDecompiledFunction(std::size_t addr, const CallOptions& opts = CallOptions());
+    /// Query decompilations for many addresses at once.
+    /// Lookups are batched into few system.multicall requests, or sent individually
+    /// if the server doesn't support multicall. A failing lookup does not fail the others.
+    /// Results are in the same order as the addresses.
+    std::vector<DecompileResult> queryDecompiledFunctions(const std::vector<std::size_t>& addrs,
+                                                          const CallOptions& opts = CallOptions());
     /// Query detailed information about a function containing the given address.
-    FunctionData queryFunctionData(std::size_t addr);
+    FunctionData queryFunctionData(std::size_t addr, const CallOptions& opts = CallOptions());
+    /// Set how many *Async calls may be in flight at once (default 8).
+    /// Calls beyond that are queued until a slot frees up.
+    void setMaxInFlight(std::size_t max);
+    /// Asynchronous variant of queryDecompiledFunction().
+    std::future<DecompiledFunction> queryDecompiledFunctionAsync(std::size_t addr,
+                                                                 const CallOptions& opts = CallOptions());
+    /// Asynchronous variant of queryFunctionData().
+    std::future<FunctionData> queryFunctionDataAsync(std::size_t addr, const CallOptions& opts = CallOptions());
     /// Query global variables.
-    std::vector<Symbol> queryGlobalVars();
+    std::vector<Symbol> queryGlobalVars(const CallOptions& opts = CallOptions());
+    /// Visitor variant of queryGlobalVars(), see forEachFunctionHeader().
+    void forEachGlobalVar(const std::function<void(const Symbol&)>& sink, const CallOptions& opts = CallOptions());
+    /// Paged variant of queryGlobalVars(), see forEachFunctionHeader().
+    void forEachGlobalVar(std::size_t pageSize, const std::function<void(const std::vector<Symbol>&)>& sink,
+                          const CallOptions& opts = CallOptions());
     /// Query structures.
-    std::unordered_map<std::string, Structure> queryStructs();
+    std::unordered_map<std::string, Structure> queryStructs(const CallOptions& opts = CallOptions());
+    /// Visitor variant of queryStructs(), see forEachFunctionHeader().
+    void forEachStruct(const std::function<void(const Structure&)>& sink, const CallOptions& opts = CallOptions());
     /// Query type aliases.
-    std::unordered_map<std::string, TypeAlias> queryTypeAliases();
+    std::unordered_map<std::string, TypeAlias> queryTypeAliases(const CallOptions& opts = CallOptions());
     /// Query all unions.
-    std::unordered_map<std::string, Union> queryUnions();
+    std::unordered_map<std::string, Union> queryUnions(const CallOptions& opts = CallOptions());
     /// Query all enums.
-    std::unordered_map<std::string, Enum> queryEnums();
+    std::unordered_map<std::string, Enum> queryEnums(const CallOptions& opts = CallOptions());
+
+    /// Protocol revision this client speaks, announced to the server during the handshake.
+    static constexpr int PROTOCOL_VERSION = 1;
 
    private:
-    void log(const std::string& msg);
+    /// Maximum number of lookups packed into a single batch request.
+    static constexpr std::size_t BATCH_CHUNK_SIZE = 256;
+
+    /// Ask the server what it supports, falling back to introspection for servers predating d2d.capabilities.
+    ServerCapabilities handshake(const CallOptions& opts);
+    /// Send lookups in batches, either through d2d.decompile_many (`bulk`) or system.multicall.
+    std::vector<DecompileResult> queryDecompiledFunctionsBatched(const std::vector<std::size_t>& addrs,
+                                                                 const CallOptions& opts, bool bulk);
+    DecompiledFunction decodeDecompiledFunction(const ValueView& v);
+    /// Add the token cancelAll() cancels to the options of a call.
+    CallOptions withSession(const CallOptions& opts);
+    /// Perform a single RPC, throwing on transport errors and faults.
+    /// Joins an identical call if one is already in flight.
+    xmlrpc_c::value call(const std::string& method, const xmlrpc_c::paramList& params, const CallOptions& opts);
+    /// Perform a single RPC, feeding the response to the decoder as it arrives.
+    void callStreaming(const std::string& method, StreamDecoder& decoder, const CallOptions& opts);
+    /// Run `fn`, accounting the time it takes as decoding a response to `method`.
+    template <typename F>
+    auto timeDecode(const std::string& method, F&& fn);
+    /// Run the given function on the worker pool.
+    template <typename T>
+    std::future<T> submit(std::function<T()> fn);
+    /// Run all of `fns` concurrently on the worker pool, with the calling thread running those not started yet itself.
+    /// Only ever waits on functions already running, so unlike waiting on submit() it's safe from a pool worker too.
+    template <typename T>
+    std::vector<std::future<T>> runConcurrently(std::vector<std::function<T()>> fns);
 
-    bool m_verbose;
-    std::string m_url;
+    Logger m_log;
+    std::shared_ptr<Transport> m_transport;
+    std::atomic<bool> m_multicallUnsupported;
+    std::atomic<bool> m_bulkDecompile;
+    std::mutex m_capabilitiesLock;
+    std::optional<ServerCapabilities> m_capabilities;
+    std::unique_ptr<SingleFlight<xmlrpc_c::value>> m_inFlight;
+    std::unique_ptr<Metrics> m_metrics;
+    // Replaced by a fresh token on every cancelAll()
+    std::mutex m_sessionLock;
+    CancellationToken m_session;
+    // Created on first use. Declared last, so queued jobs finish before anything they use is destroyed.
+    std::mutex m_workersLock;
+    std::size_t m_maxInFlight;
+    std::unique_ptr<WorkerPool> m_workers;
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+//! Leveled logging that costs next to nothing for messages nobody will see.
+//! Always log through the LOG_* macros: their arguments are neither evaluated nor formatted unless
+//! the logger's level lets the message through, and levels below D2D_MIN_LOG_LEVEL are compiled out entirely.
+
+#include <fmt/core.h>
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+enum class LogLevel { Trace = 0, Debug = 1, Info = 2, Warn = 3, Error = 4, Off = 5 };
+
+/// Least severe level that's compiled in at all, as the number of a LogLevel.
+/// Release builds drop trace messages unless told otherwise.
+#ifndef D2D_MIN_LOG_LEVEL
+#ifdef NDEBUG
+#define D2D_MIN_LOG_LEVEL 1
+#else
+#define D2D_MIN_LOG_LEVEL 0
+#endif
+#endif
+
+/// Lowercase name of `level`, as accepted by parseLogLevel().
+const char* logLevelName(LogLevel level);
+/// The level called `name`, if any.
+std::optional<LogLevel> parseLogLevel(std::string_view name);
+
+/// Hands messages of at least a given level to a sink.
+class Logger {
+   public:
+    /// Receives every message that is written.
+    using Sink = std::function<void(LogLevel level, const std::string& msg)>;
+
+    Logger() = delete;
+    /// Prints to stdout, prefixed with `component`.
+    explicit Logger(std::string component, LogLevel level = LogLevel::Info);
+    Logger(LogLevel level, Sink sink);
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    bool enabled(LogLevel level) const { return level >= m_level.load(std::memory_order_relaxed); }
+    LogLevel level() const;
+    void setLevel(LogLevel level);
+    void setSink(Sink sink);
+    /// Write `msg` regardless of level. Use the LOG_* macros instead, which check first.
+    void write(LogLevel level, const std::string& msg) const;
+
+   private:
+    std::atomic<LogLevel> m_level;
+    mutable std::mutex m_sinkLock;
+    Sink m_sink;
+};
+
+#define D2D_LOG(logger, level, ...)                                   \
+    do {                                                              \
+        if constexpr (static_cast<int>(level) >= D2D_MIN_LOG_LEVEL) { \
+            if ((logger).enabled(level)) {                            \
+                (logger).write((level), fmt::format(__VA_ARGS__));    \
+            }                                                         \
+        }                                                             \
+    } while (false)
+
+#define LOG_TRACE(logger, ...) D2D_LOG(logger, LogLevel::Trace, __VA_ARGS__)
+#define LOG_DEBUG(logger, ...) D2D_LOG(logger, LogLevel::Debug, __VA_ARGS__)
+#define LOG_INFO(logger, ...) D2D_LOG(logger, LogLevel::Info, __VA_ARGS__)
+#define LOG_WARN(logger, ...) D2D_LOG(logger, LogLevel::Warn, __VA_ARGS__)
+#define LOG_ERROR(logger, ...) D2D_LOG(logger, LogLevel::Error, __VA_ARGS__)
@@ -0,0 +1,51 @@
+#pragma once
+
+//! Calls through shared memory, for a decompiler running on the same machine.
+//! Requests and responses are still XML-RPC, but they are handed over through a pair of rings
+//! in memory mapped by both processes instead of going through the loopback network stack.
+//! Windows only.
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "transport.h"
+
+/// Talks to a bridge process serving the shared memory channel called `name`, such as clientShmBridge.
+/// Responses are handed out piece by piece straight from the shared memory, without copying them first.
+/// There is only one channel, so calls from several threads take turns.
+/// Only one client process may use a channel at a time.
+class SharedMemoryTransport : public Transport {
+   public:
+    SharedMemoryTransport() = delete;
+    /// Throws if nothing is serving the channel.
+    explicit SharedMemoryTransport(const std::string& name);
+    SharedMemoryTransport(const SharedMemoryTransport&) = delete;
+    SharedMemoryTransport& operator=(const SharedMemoryTransport&) = delete;
+    ~SharedMemoryTransport() override;
+
+    void roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) override;
+    WireStats wireStats() const override;
+
+   private:
+    struct Channel;
+
+    void readResponse(const DataSink& onData, const CallOptions& opts);
+
+    std::unique_ptr<Channel> m_channel;
+    std::mutex m_lock;
+    // Responses the bridge still owes, including the one being read. Ones to abandoned calls are skipped.
+    std::uint64_t m_owed;
+    // How far into the response being read we are, for picking up after an abandoned call
+    std::array<char, 4> m_frameHeader;
+    std::size_t m_frameHeaderRead;
+    std::uint32_t m_bodyLeft;
+    // Set when a request was abandoned halfway, leaving the bridge with a request it can never complete
+    bool m_broken;
+    std::atomic<std::uint64_t> m_requestBytes;
+    std::atomic<std::uint64_t> m_responseBytes;
+};
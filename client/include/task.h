@@ -0,0 +1,224 @@
+#pragma once
+
+//! Minimal coroutine task type for the C++20 API of the client, see async_client.h.
+//! Tasks are lazy: nothing runs until the task is awaited or started,
+//! and awaiting one resumes the awaiting coroutine right where the task finishes, on the same thread.
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <optional>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class Task;
+
+/// Bookkeeping shared by the promises of all tasks.
+class TaskPromiseBase {
+   public:
+    /// Hands control back to whoever awaited the task, if anyone.
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template <typename P>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<P> h) const noexcept {
+            const std::coroutine_handle<> next = h.promise().m_continuation;
+            return next ? next : std::noop_coroutine();
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { m_error = std::current_exception(); }
+
+    void setContinuation(std::coroutine_handle<> continuation) { m_continuation = continuation; }
+    void rethrowIfFailed() const {
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+   private:
+    std::coroutine_handle<> m_continuation;
+    std::exception_ptr m_error;
+};
+
+template <typename T>
+class TaskPromise : public TaskPromiseBase {
+   public:
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U&& value) {
+        m_value.emplace(std::forward<U>(value));
+    }
+    T takeResult() {
+        rethrowIfFailed();
+        return std::move(*m_value);
+    }
+
+   private:
+    std::optional<T> m_value;
+};
+
+template <>
+class TaskPromise<void> : public TaskPromiseBase {
+   public:
+    Task<void> get_return_object();
+    void return_void() {}
+    void takeResult() { rethrowIfFailed(); }
+};
+
+/// The result of a coroutine returning `T`, to be awaited by another coroutine.
+/// Exceptions thrown by the coroutine are rethrown to whoever awaits it.
+/// Coroutines only start running when awaited, so they should take their parameters by value:
+/// anything they refer to has to outlive the task.
+template <typename T>
+class Task {
+   public:
+    using promise_type = TaskPromise<T>;
+
+    Task() = delete;
+    explicit Task(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    Task(Task&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() { destroy(); }
+
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        m_handle.promise().setContinuation(awaiting);
+        return m_handle;
+    }
+    T await_resume() { return m_handle.promise().takeResult(); }
+
+    /// Run the coroutine up to its first suspension, for driving a task from outside any coroutine.
+    void start() { m_handle.resume(); }
+    bool done() const { return m_handle.done(); }
+    /// The coroutine's result once it's done(), rethrowing what it threw.
+    T result() { return m_handle.promise().takeResult(); }
+
+   private:
+    void destroy() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+/// Progress of a whenAll(), shared by the tasks it waits for.
+struct WhenAllState {
+    /// Tasks still running, plus one for whenAll() itself until it has started all of them.
+    std::size_t remaining;
+    std::coroutine_handle<> awaiting;
+};
+
+/// Resumes whenAll() once the last task is done, instead of whoever awaited that task.
+struct WhenAllDone {
+    WhenAllState& state;
+
+    bool await_ready() const noexcept { return --state.remaining != 0; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<>) const noexcept { return state.awaiting; }
+    void await_resume() const noexcept {}
+};
+
+/// Runs one of the tasks of a whenAll(), keeping its outcome for later.
+class WhenAllChild {
+   public:
+    struct promise_type {
+        WhenAllChild get_return_object() {
+            return WhenAllChild(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        // The last child to finish has already passed control on to whenAll() by now
+        std::suspend_always final_suspend() const noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit WhenAllChild(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+    WhenAllChild(WhenAllChild&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+    WhenAllChild(const WhenAllChild&) = delete;
+    WhenAllChild& operator=(const WhenAllChild&) = delete;
+    ~WhenAllChild() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    void start() { m_handle.resume(); }
+
+   private:
+    std::coroutine_handle<promise_type> m_handle;
+};
+
+template <typename T>
+WhenAllChild runWhenAllChild(Task<T>& task, std::optional<T>& out, std::exception_ptr& error, WhenAllState& state) {
+    try {
+        out.emplace(co_await task);
+    } catch (...) {
+        error = std::current_exception();
+    }
+    co_await WhenAllDone{state};
+}
+
+/// Starts all children, and only suspends whenAll() if any of them is still running afterwards.
+struct WhenAllStart {
+    std::vector<WhenAllChild>& children;
+    WhenAllState& state;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> awaiting) const {
+        state.awaiting = awaiting;
+        for (auto& child : children) {
+            child.start();
+        }
+        return --state.remaining != 0;
+    }
+    void await_resume() const noexcept {}
+};
+
+/// Run all `tasks` concurrently, returning their results in the same order once all of them are done.
+/// If any of them fails, the first failure in order is rethrown, once all of them are done.
+template <typename T>
+Task<std::vector<T>> whenAll(std::vector<Task<T>> tasks) {
+    WhenAllState state{tasks.size() + 1, nullptr};
+    std::vector<std::optional<T>> results(tasks.size());
+    std::vector<std::exception_ptr> errors(tasks.size());
+    std::vector<WhenAllChild> children{};
+    children.reserve(tasks.size());
+    for (std::size_t i = 0; i < tasks.size(); i++) {
+        children.push_back(runWhenAllChild(tasks[i], results[i], errors[i], state));
+    }
+    co_await WhenAllStart{children, state};
+
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+    std::vector<T> out{};
+    out.reserve(results.size());
+    for (auto& result : results) {
+        out.push_back(std::move(*result));
+    }
+    co_return out;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+//! Transports carry serialized XML-RPC requests to a decompiler server and bring back its responses.
+//! The client only deals in serialized requests and responses, so the same encoding and decoding
+//! runs over HTTP, some other channel, or directly against an in-process handler.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cancellation.h"
+
+/// Byte counts of all traffic exchanged with the server,
+/// both before compression and as actually sent over the wire.
+struct WireStats {
+    std::uint64_t requestBytes;
+    std::uint64_t requestWireBytes;
+    std::uint64_t responseBytes;
+    std::uint64_t responseWireBytes;
+};
+
+class Transport {
+   public:
+    using DataSink = std::function<void(const char* data, std::size_t len)>;
+    /// Called once a round trip started with startRoundTrip() is over, with what it failed with, if anything.
+    using Completion = std::function<void(std::exception_ptr error)>;
+
+    virtual ~Transport() = default;
+    /// Send a serialized request, handing the serialized response to `onData` piece by piece as it arrives.
+    /// Exceptions thrown by `onData` abort the exchange and are rethrown.
+    /// Throws CancelledError as soon as `opts` say so, even while waiting for the response.
+    /// Must be safe to call from multiple threads at once.
+    virtual void roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) = 0;
+    /// Start a round trip without waiting for it, for callers that mustn't block, such as coroutines.
+    /// Same as roundTrip() otherwise, except that `onData` and then `onDone` are called on whichever thread the
+    /// round trip is carried out on. The transport must be kept alive until `onDone` is called.
+    /// By default runs roundTrip() on a small pool of threads shared by all transports.
+    virtual void startRoundTrip(std::string request, DataSink onData, CallOptions opts, Completion onDone);
+    /// Traffic statistics accumulated over the lifetime of the transport.
+    virtual WireStats wireStats() const;
+    /// Send large request bodies compressed from now on, if the transport can.
+    /// Only called once the server is known to accept compressed requests.
+    virtual void compressRequests();
+    /// Whether calls stand a chance of getting through right now.
+    /// False when the server is known to be unreachable and calls would fail straight away.
+    virtual bool available() const;
+};
+
+class HttpConnection;
+
+/// XML-RPC over HTTP.
+/// Connections are kept alive and reused across calls, one is checked out per call in flight.
+/// Responses are requested gzip or deflate compressed, and decompressed transparently.
+class HttpTransport : public Transport {
+   public:
+    HttpTransport() = delete;
+    explicit HttpTransport(const std::string& url);
+    HttpTransport(const HttpTransport&) = delete;
+    HttpTransport& operator=(const HttpTransport&) = delete;
+    ~HttpTransport() override;
+
+    /// Send large request bodies, such as multicall batches, gzip-compressed.
+    /// Only enable if the server understands compressed requests (Python's XML-RPC server does).
+    void compressRequests() override;
+    void roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) override;
+    WireStats wireStats() const override;
+
+   private:
+    std::unique_ptr<HttpConnection> acquireConnection();
+    void releaseConnection(std::unique_ptr<HttpConnection> conn);
+
+    std::string m_url;
+    std::atomic<bool> m_compressRequests;
+    std::atomic<std::uint64_t> m_requestBytes;
+    std::atomic<std::uint64_t> m_requestWireBytes;
+    std::atomic<std::uint64_t> m_responseBytes;
+    std::atomic<std::uint64_t> m_responseWireBytes;
+    std::mutex m_poolLock;
+    std::vector<std::unique_ptr<HttpConnection>> m_idleConns;
+};
+
+/// Hands requests straight to a handler in the same process.
+/// Useful for measuring decoding and everything downstream of it in isolation from the network.
+class LoopbackTransport : public Transport {
+   public:
+    /// Takes a serialized request and returns the serialized response.
+    using Handler = std::function<std::string(const std::string& request)>;
+
+    LoopbackTransport() = delete;
+    explicit LoopbackTransport(Handler handler);
+
+    void roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) override;
+    WireStats wireStats() const override;
+
+   private:
+    Handler m_handler;
+    std::atomic<std::uint64_t> m_requestBytes;
+    std::atomic<std::uint64_t> m_responseBytes;
+};
@@ -0,0 +1,282 @@
+#include "async_client.h"
+
+#include <fmt/core.h>
+#include <xmlrpc-c/base.h>
+
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include <xmlrpc-c/base.hpp>
+#include <xmlrpc-c/xml.hpp>
+
+#include "decode.h"
+#include "metrics.h"
+#include "stream_decoder.h"
+#include "value_view.h"
+
+/// State of a round trip shared between the awaiting coroutine and the transport's thread carrying it out.
+struct AsyncClient::Exchange {
+    std::coroutine_handle<> awaiting;
+    /// Cancelled once the awaiting coroutine is gone, so the transport can stop early.
+    CancellationToken abandon;
+    // Only touched on the thread running the event loop
+    bool completed = false;
+    bool abandoned = false;
+    std::exception_ptr error;
+    // Only touched on the transport's thread
+    std::size_t received = 0;
+    std::chrono::nanoseconds handling{0};
+};
+
+/// What roundTrip() returns, resuming the awaiting coroutine on the event loop once the transport is done.
+class AsyncClient::RoundTrip {
+   public:
+    RoundTrip() = delete;
+    RoundTrip(AsyncClient& client, std::string method, std::string request, Transport::DataSink onData,
+              CallOptions opts)
+        : m_client(client),
+          m_method(std::move(method)),
+          m_request(std::move(request)),
+          m_onData(std::move(onData)),
+          m_opts(std::move(opts)),
+          m_exchange(std::make_shared<Exchange>()) {}
+    RoundTrip(const RoundTrip&) = delete;
+    RoundTrip& operator=(const RoundTrip&) = delete;
+    /// Abandons the round trip if it's still running, e.g. because the awaiting coroutine was destroyed.
+    ~RoundTrip() {
+        if (m_exchange->awaiting && !m_exchange->completed) {
+            m_exchange->abandoned = true;
+            m_exchange->abandon.cancel();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> awaiting) {
+        m_exchange->awaiting = awaiting;
+        m_opts.tokens.push_back(m_exchange->abandon);
+        // Everything the transport's thread touches is kept alive by the callbacks themselves
+        const auto exchange = m_exchange;
+        const auto inbox = m_client.m_inbox;
+        const auto metrics = m_client.m_metrics;
+        const auto transport = m_client.m_transport;
+        const std::size_t requestBytes = m_request.size();
+        const auto start = std::chrono::steady_clock::now();
+        auto onData = [exchange, onData = std::move(m_onData)](const char* data, std::size_t len) {
+            const auto handlingStart = std::chrono::steady_clock::now();
+            exchange->received += len;
+            onData(data, len);
+            exchange->handling += std::chrono::steady_clock::now() - handlingStart;
+        };
+        auto onDone = [exchange, inbox, metrics, transport, method = m_method, requestBytes,
+                       start](std::exception_ptr error) {
+            // Time spent decoding while the response streamed in isn't the server's doing
+            const auto latency = std::chrono::steady_clock::now() - start - exchange->handling;
+            metrics->recordCall(method, latency, requestBytes, exchange->received, error != nullptr);
+            if (exchange->handling.count() != 0) {
+                metrics->recordDecode(method, exchange->handling, false);
+            }
+            {
+                const auto g = std::lock_guard<std::mutex>(inbox->lock);
+                inbox->ready.push_back([exchange, error]() {
+                    if (exchange->abandoned) {
+                        return;
+                    }
+                    exchange->completed = true;
+                    exchange->error = error;
+                    exchange->awaiting.resume();
+                });
+            }
+            inbox->wake.notify_one();
+        };
+        transport->startRoundTrip(std::move(m_request), std::move(onData), std::move(m_opts), std::move(onDone));
+    }
+
+    /// Rethrows whatever the round trip failed with.
+    void await_resume() const {
+        if (m_exchange->error) {
+            std::rethrow_exception(m_exchange->error);
+        }
+    }
+
+   private:
+    AsyncClient& m_client;
+    std::string m_method;
+    std::string m_request;
+    Transport::DataSink m_onData;
+    CallOptions m_opts;
+    std::shared_ptr<Exchange> m_exchange;
+};
+
+AsyncClient::AsyncClient(const std::string& endpoint_url) : AsyncClient(guardedHttpTransport(endpoint_url)) {}
+
+AsyncClient::AsyncClient(std::shared_ptr<Transport> transport)
+    : m_transport(std::move(transport)), m_inbox(std::make_shared<Inbox>()), m_metrics(std::make_shared<Metrics>()) {
+    // Responses get really big, same as for Client
+    xmlrpc_limit_set(XMLRPC_XML_SIZE_LIMIT_ID, 1024 * 1024 * 64);  // 64 MiB
+}
+
+AsyncClient::~AsyncClient() = default;
+
+WireStats AsyncClient::wireStats() const { return m_transport->wireStats(); }
+
+std::vector<MethodMetrics> AsyncClient::metrics() const { return m_metrics->snapshot(); }
+
+std::string AsyncClient::dumpMetrics() const { return formatMetrics(m_metrics->snapshot()); }
+
+void AsyncClient::step() {
+    std::function<void()> next;
+    {
+        auto l = std::unique_lock<std::mutex>(m_inbox->lock);
+        m_inbox->wake.wait(l, [this]() { return !m_inbox->ready.empty(); });
+        next = std::move(m_inbox->ready.front());
+        m_inbox->ready.pop_front();
+    }
+    // One at a time and outside the lock, as resuming a coroutine may well start new round trips
+    next();
+}
+
+template <typename F>
+auto AsyncClient::timeDecode(const std::string& method, F&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        auto result = fn();
+        m_metrics->recordDecode(method, std::chrono::steady_clock::now() - start, false);
+        return result;
+    } catch (...) {
+        m_metrics->recordDecode(method, std::chrono::steady_clock::now() - start, true);
+        throw;
+    }
+}
+
+AsyncClient::RoundTrip AsyncClient::roundTrip(std::string method, std::string request, Transport::DataSink onData,
+                                              CallOptions opts) {
+    return RoundTrip(*this, std::move(method), std::move(request), std::move(onData), std::move(opts));
+}
+
+Task<xmlrpc_c::value> AsyncClient::call(std::string method, xmlrpc_c::paramList params, CallOptions opts) {
+    opts.check();
+    std::string request;
+    xmlrpc_c::xml::generateCall(method, params, &request);
+    // Appended to on the transport's thread, only read once the round trip is done
+    const auto response = std::make_shared<std::string>();
+    co_await roundTrip(
+        method, std::move(request), [response](const char* data, std::size_t len) { response->append(data, len); },
+        std::move(opts));
+
+    co_return timeDecode(method, [&]() {
+        xmlrpc_c::rpcOutcome outcome;
+        xmlrpc_c::xml::parseResponse(*response, &outcome);
+        if (!outcome.succeeded()) {
+            const auto fault = outcome.getFault();
+            throw FaultError(fault.getCode(), fault.getDescription());
+        }
+        return outcome.getResult();
+    });
+}
+
+Task<void> AsyncClient::callStreaming(std::string method, std::shared_ptr<StreamDecoder> decoder, CallOptions opts) {
+    opts.check();
+    std::string request;
+    xmlrpc_c::xml::generateCall(method, xmlrpc_c::paramList(), &request);
+    co_await roundTrip(
+        method, std::move(request), [decoder](const char* data, std::size_t len) { decoder->feed(data, len); },
+        std::move(opts));
+    timeDecode(method, [&decoder]() {
+        decoder->finish();
+        return true;
+    });
+}
+
+Task<void> AsyncClient::ping(CallOptions opts) {
+    try {
+        co_await call("d2d.ping", xmlrpc_c::paramList(), opts);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to ping server: {}", e.what()));
+    }
+
+    try {
+        const xmlrpc_c::value out = co_await call(
+            "d2d.capabilities", xmlrpc_c::paramList().add(xmlrpc_c::value_int(Client::PROTOCOL_VERSION)),
+            std::move(opts));
+        if (timeDecode("d2d.capabilities", [&]() { return decodeCapabilities(ValueRoot(out).view()); })
+                .compressedRequests) {
+            m_transport->compressRequests();
+        }
+    } catch (const FaultError&) {
+        // Predates d2d.capabilities, and compressed requests along with it
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to discover server capabilities: {}", e.what()));
+    }
+}
+
+Task<std::vector<Symbol>> AsyncClient::queryFunctionHeaders(CallOptions opts) {
+    try {
+        // This is a map, where the function address is the key
+        const auto symbols = std::make_shared<std::vector<Symbol>>();
+        const auto decoder = std::make_shared<StreamDecoder>(
+            std::vector<std::string>{}, [symbols](const std::string& key, const StreamValue& v) {
+                symbols->push_back(decodeSymbol(SymbolType::Function, key, v));
+            });
+        co_await callStreaming("d2d.function_headers", decoder, std::move(opts));
+        co_return std::move(*symbols);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to query function headers: {}", e.what()));
+    }
+}
+
+Task<std::vector<Symbol>> AsyncClient::queryGlobalVars(CallOptions opts) {
+    try {
+        // This is a map, where the variable's address is the key
+        const auto symbols = std::make_shared<std::vector<Symbol>>();
+        const auto decoder = std::make_shared<StreamDecoder>(
+            std::vector<std::string>{}, [symbols](const std::string& key, const StreamValue& v) {
+                symbols->push_back(decodeSymbol(SymbolType::Other, key, v));
+            });
+        co_await callStreaming("d2d.global_vars", decoder, std::move(opts));
+        co_return std::move(*symbols);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to query global variables: {}", e.what()));
+    }
+}
+
+Task<DecompiledFunction> AsyncClient::queryDecompiledFunction(std::size_t addr, CallOptions opts) {
+    try {
+        // Worth sending to a second server if the first is slow, same as for Client
+        opts.hedge = true;
+        const xmlrpc_c::value out =
+            co_await call("d2d.decompile", xmlrpc_c::paramList().add(xmlrpc_c::value_int(addr)), std::move(opts));
+        co_return timeDecode("d2d.decompile", [&]() { return decodeDecompiledFunction(ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to query function decompilation: {}", e.what()));
+    }
+}
+
+Task<FunctionData> AsyncClient::queryFunctionData(std::size_t addr, CallOptions opts) {
+    try {
+        const xmlrpc_c::value out =
+            co_await call("d2d.function_data", xmlrpc_c::paramList().add(xmlrpc_c::value_int(addr)), std::move(opts));
+        co_return timeDecode("d2d.function_data", [&]() { return decodeFunctionData(ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to query function data: {}", e.what()));
+    }
+}
@@ -0,0 +1,227 @@
+#include "balancing.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "worker_pool.h"
+
+/// Hedges waiting to be sent or in flight at once. Beyond that, hedges are sent late, as pool threads free up.
+static constexpr std::size_t HEDGERS = 8;
+
+/// Keeps a call counted as outstanding on an endpoint for as long as it's alive.
+template <typename E>
+class Outstanding {
+   public:
+    explicit Outstanding(E& endpoint) : m_endpoint(endpoint) {}
+    Outstanding(const Outstanding&) = delete;
+    Outstanding& operator=(const Outstanding&) = delete;
+    ~Outstanding() { m_endpoint.outstanding--; }
+
+   private:
+    E& m_endpoint;
+};
+
+BalancingTransport::BalancingTransport(std::vector<std::shared_ptr<Transport>> endpoints,
+                                       std::optional<std::chrono::milliseconds> hedgeAfter)
+    : m_hedgeAfter(hedgeAfter),
+      m_next(0),
+      m_hedged(0),
+      m_hedgeWins(0),
+      m_hedgers(std::make_unique<WorkerPool>(HEDGERS)) {
+    if (endpoints.empty()) {
+        throw std::invalid_argument("At least one endpoint is required");
+    }
+    for (auto& t : endpoints) {
+        auto e = std::make_unique<Endpoint>();
+        e->transport = std::move(t);
+        m_endpoints.push_back(std::move(e));
+    }
+}
+
+BalancingTransport::~BalancingTransport() = default;
+
+BalancingTransport::Endpoint& BalancingTransport::acquire(const Endpoint* exclude) {
+    const std::size_t n = m_endpoints.size();
+    const std::size_t first = m_next++ % n;
+    Endpoint* best = nullptr;
+    bool bestAvailable = false;
+    std::uint64_t bestOutstanding = std::numeric_limits<std::uint64_t>::max();
+    for (std::size_t i = 0; i < n; i++) {
+        Endpoint& e = *m_endpoints[(first + i) % n];
+        if (&e == exclude) {
+            continue;
+        }
+        const bool available = e.transport->available();
+        const std::uint64_t outstanding = e.outstanding;
+        if ((available && !bestAvailable) || (available == bestAvailable && outstanding < bestOutstanding)) {
+            best = &e;
+            bestAvailable = available;
+            bestOutstanding = outstanding;
+        }
+    }
+    best->outstanding++;
+    best->calls++;
+    return *best;
+}
+
+void BalancingTransport::roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) {
+    if (opts.hedge && m_hedgeAfter && m_endpoints.size() > 1) {
+        hedgedRoundTrip(request, onData, opts);
+        return;
+    }
+    Endpoint& e = acquire(nullptr);
+    const Outstanding<Endpoint> o(e);
+    e.transport->roundTrip(request, onData, opts);
+}
+
+/// State of one hedged call shared with its hedge, which may outlive the call if it never got sent.
+struct BalancingTransport::Race {
+    enum class Winner { None, Primary, Hedge };
+
+    std::mutex lock;
+    std::condition_variable hedgeDone;
+    bool hedgeSent = false;
+    bool hedgeFinished = false;
+    Winner winner = Winner::None;
+    std::string hedgeResponse;
+    // Each attempt can be called off on its own, once the other one won
+    CancellationToken primaryToken;
+    CancellationToken hedgeToken;
+};
+
+void BalancingTransport::hedgedRoundTrip(const std::string& request, const DataSink& onData,
+                                         const CallOptions& opts) {
+    const auto start = CallOptions::Clock::now();
+    const auto race = std::make_shared<Race>();
+    CallOptions primaryOpts = opts;
+    primaryOpts.tokens.push_back(race->primaryToken);
+    CallOptions hedgeOpts = opts;
+    hedgeOpts.tokens.push_back(race->hedgeToken);
+
+    Endpoint& primary = acquire(nullptr);
+    m_hedgers->submit([this, race, request, hedgeOpts, start, &primary]() {
+        try {
+            hedgeOpts.sleepUntil(start + *m_hedgeAfter);
+            {
+                const auto g = std::lock_guard<std::mutex>(race->lock);
+                if (race->winner != Race::Winner::None) {
+                    return;
+                }
+                race->hedgeSent = true;
+            }
+            m_hedged++;
+            Endpoint& second = acquire(&primary);
+            std::string response;
+            {
+                const Outstanding<Endpoint> o(second);
+                second.transport->roundTrip(
+                    request, [&response](const char* data, std::size_t len) { response.append(data, len); },
+                    hedgeOpts);
+            }
+            const auto g = std::lock_guard<std::mutex>(race->lock);
+            if (race->winner == Race::Winner::None) {
+                race->winner = Race::Winner::Hedge;
+                race->hedgeResponse = std::move(response);
+                race->primaryToken.cancel();
+            }
+        } catch (const std::exception&) {
+            // Either cancelled because the primary won, or failed, in which case the primary's outcome counts
+        }
+        const auto g = std::lock_guard<std::mutex>(race->lock);
+        race->hedgeFinished = true;
+        race->hedgeDone.notify_all();
+    });
+
+    std::string primaryResponse;
+    std::exception_ptr primaryError;
+    try {
+        const Outstanding<Endpoint> o(primary);
+        primary.transport->roundTrip(
+            request, [&primaryResponse](const char* data, std::size_t len) { primaryResponse.append(data, len); },
+            primaryOpts);
+        const auto g = std::lock_guard<std::mutex>(race->lock);
+        if (race->winner == Race::Winner::None) {
+            race->winner = Race::Winner::Primary;
+            race->hedgeToken.cancel();
+        }
+    } catch (...) {
+        primaryError = std::current_exception();
+        const auto g = std::lock_guard<std::mutex>(race->lock);
+        // No point in waiting for a hedge that wasn't even sent yet
+        if (!race->hedgeSent) {
+            race->hedgeToken.cancel();
+        }
+    }
+
+    Race::Winner winner;
+    {
+        auto l = std::unique_lock<std::mutex>(race->lock);
+        // A hedge that was sent decides the outcome if the primary failed, and is cancelled otherwise.
+        // One that wasn't is left to notice the call is over whenever the pool gets to it.
+        if (race->hedgeSent) {
+            race->hedgeDone.wait(l, [&race]() { return race->hedgeFinished; });
+        }
+        winner = race->winner;
+    }
+    switch (winner) {
+        case Race::Winner::Primary:
+            onData(primaryResponse.data(), primaryResponse.size());
+            break;
+        case Race::Winner::Hedge:
+            m_hedgeWins++;
+            onData(race->hedgeResponse.data(), race->hedgeResponse.size());
+            break;
+        case Race::Winner::None:
+            std::rethrow_exception(primaryError);
+    }
+}
+
+WireStats BalancingTransport::wireStats() const {
+    WireStats total{0, 0, 0, 0};
+    for (const auto& e : m_endpoints) {
+        const WireStats s = e->transport->wireStats();
+        total.requestBytes += s.requestBytes;
+        total.requestWireBytes += s.requestWireBytes;
+        total.responseBytes += s.responseBytes;
+        total.responseWireBytes += s.responseWireBytes;
+    }
+    return total;
+}
+
+void BalancingTransport::compressRequests() {
+    for (const auto& e : m_endpoints) {
+        e->transport->compressRequests();
+    }
+}
+
+bool BalancingTransport::available() const {
+    for (const auto& e : m_endpoints) {
+        if (e->transport->available()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<EndpointStats> BalancingTransport::endpointStats() const {
+    std::vector<EndpointStats> stats{};
+    stats.reserve(m_endpoints.size());
+    for (const auto& e : m_endpoints) {
+        stats.push_back(EndpointStats{e->calls, e->outstanding});
+    }
+    return stats;
+}
+
+std::uint64_t BalancingTransport::hedgedCalls() const { return m_hedged; }
+
+std::uint64_t BalancingTransport::hedgeWins() const { return m_hedgeWins; }
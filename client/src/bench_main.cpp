@@ -0,0 +1,606 @@
+//! Benchmarks for the client library.
+//! The network benchmarks run against a real decompiler or against clientStandIn,
+//! the decode benchmarks run on synthetic responses.
+//! The compression benchmark also needs clientCompressingStandIn serving the same data.
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <future>
+#include <optional>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <xmlrpc-c/base.hpp>
+#include <xmlrpc-c/client_simple.hpp>
+#include <xmlrpc-c/registry.hpp>
+#include <xmlrpc-c/xml.hpp>
+
+#include "balancing.h"
+#include "capture.h"
+#include "client.h"
+#include "decode.h"
+#include "interval_set.h"
+#include "log.h"
+#include "shm_transport.h"
+#include "stand_in.h"
+#include "value_view.h"
+
+using Clock = std::chrono::steady_clock;
+
+/// Number of heap allocations made by C++ code so far.
+static std::atomic<std::size_t> ALLOCATIONS{0};
+
+void* operator new(std::size_t size) {
+    ALLOCATIONS++;
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+/// Time each invocation of `fn` and print latency statistics.
+static void measure(const std::string& name, int iterations, const std::function<void(int)>& fn) {
+    std::vector<double> us{};
+    us.reserve(iterations);
+    for (int i = 0; i < iterations; i++) {
+        const auto start = Clock::now();
+        fn(i);
+        us.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+    }
+    std::sort(us.begin(), us.end());
+    double total = 0;
+    for (const auto t : us) {
+        total += t;
+    }
+    fmt::print("{:<32} mean {:>9.1f}us  p50 {:>9.1f}us  p99 {:>9.1f}us  total {:>8.1f}ms\n", name, total / iterations,
+               us.at(us.size() / 2), us.at(us.size() * 99 / 100), total / 1000);
+}
+
+/// The structure decoder as it was before walking values through views, kept as a baseline.
+/// Every level copies the struct into a std::map and every leaf goes through temporaries.
+static std::unordered_map<std::string, Structure> decodeStructsByCopy(const xmlrpc_c::value& out) {
+    std::unordered_map<std::string, Structure> structs{};
+    auto top_level = xmlrpc_c::value_struct(out).cvalue();
+    for (const auto entry : top_level) {
+        if (entry.first != "struct_info") {
+            continue;
+        }
+        for (const auto entry2 : xmlrpc_c::value_array(entry.second).cvalue()) {
+            Structure s;
+            for (const auto entry3 : xmlrpc_c::value_struct(entry2).cvalue()) {
+                if (entry3.first == "name") {
+                    s.name = static_cast<std::string>(xmlrpc_c::value_string(entry3.second).cvalue());
+                } else if (entry3.first == "members") {
+                    for (const auto member : xmlrpc_c::value_array(entry3.second).cvalue()) {
+                        StructureMember sm;
+                        for (const auto field : xmlrpc_c::value_struct(member).cvalue()) {
+                            if (field.first == "name") {
+                                sm.name = static_cast<std::string>(xmlrpc_c::value_string(field.second).cvalue());
+                            } else if (field.first == "type") {
+                                sm.type = static_cast<std::string>(xmlrpc_c::value_string(field.second).cvalue());
+                            } else if (field.first == "size") {
+                                sm.size = static_cast<std::size_t>(xmlrpc_c::value_int(field.second).cvalue());
+                            } else if (field.first == "offset") {
+                                sm.offset = static_cast<std::size_t>(xmlrpc_c::value_int(field.second).cvalue());
+                            }
+                        }
+                        s.members.push_back(sm);
+                    }
+                }
+            }
+            structs[s.name] = s;
+        }
+    }
+    return structs;
+}
+
+/// A d2d.structs response with the given number of structures of 4 members each.
+static xmlrpc_c::value syntheticStructs(int count) {
+    std::vector<xmlrpc_c::value> infos{};
+    for (int i = 0; i < count; i++) {
+        std::vector<xmlrpc_c::value> members{};
+        for (int j = 0; j < 4; j++) {
+            std::map<std::string, xmlrpc_c::value> member{
+                {"name", xmlrpc_c::value_string(fmt::format("field_{}", j))},
+                {"type", xmlrpc_c::value_string("undefined4")},
+                {"size", xmlrpc_c::value_int(4)},
+                {"offset", xmlrpc_c::value_int(j * 4)},
+            };
+            members.push_back(xmlrpc_c::value_struct(member));
+        }
+        std::map<std::string, xmlrpc_c::value> info{
+            {"name", xmlrpc_c::value_string(fmt::format("struct_{}", i))},
+            {"members", xmlrpc_c::value_array(members)},
+        };
+        infos.push_back(xmlrpc_c::value_struct(info));
+    }
+    const std::map<std::string, xmlrpc_c::value> out{{"struct_info", xmlrpc_c::value_array(infos)}};
+    return xmlrpc_c::value_struct(out);
+}
+
+/// Compare allocations and time taken by the structure decoders.
+static void benchDecode() {
+    constexpr int STRUCTS = 50000;
+    const auto payload = syntheticStructs(STRUCTS);
+    const auto run = [&](const std::string& name, const std::function<std::size_t()>& decode) {
+        const std::size_t before = ALLOCATIONS;
+        const auto start = Clock::now();
+        const std::size_t decoded = decode();
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        const std::size_t allocs = ALLOCATIONS - before;
+        fmt::print("{:<32} {} structs  {:>9} allocations ({:.1f} per struct)  {:>8.1f}ms\n", name, decoded, allocs,
+                   static_cast<double>(allocs) / STRUCTS, ms);
+    };
+    run("structs (copying maps)", [&]() { return decodeStructsByCopy(payload).size(); });
+    run("structs (schema, views)", [&]() { return decodeStructs(ValueRoot(payload).view()).size(); });
+}
+
+/// Compare what logging every line of a large decompilation costs when nobody reads the messages,
+/// formatting each one up front versus leaving it to the LOG_* macros.
+static void benchLogging() {
+    constexpr int LINES = 200000;
+    std::vector<std::string> lines{};
+    for (int i = 0; i < LINES; i++) {
+        lines.push_back(fmt::format("    local_{} = FUN_{:08x}(param_1, local_{});", i, 0x401000 + i * 0x10, i + 1));
+    }
+    std::size_t written = 0;
+    Logger log(LogLevel::Warn, [&written](LogLevel, const std::string&) { written++; });
+    const auto run = [&](const std::string& name, const std::function<void(int, const std::string&)>& logLine) {
+        const std::size_t before = ALLOCATIONS;
+        const auto start = Clock::now();
+        for (int i = 0; i < LINES; i++) {
+            logLine(i, lines[i]);
+        }
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        const std::size_t allocs = ALLOCATIONS - before;
+        fmt::print("{:<32} {} lines  {:>9} allocations  {:>8.1f}ms\n", name, LINES, allocs, ms);
+    };
+    run("log lines (eager)", [&log](int i, const std::string& line) {
+        const std::string msg = fmt::format("Line {:08x}: {}", i, line);
+        if (log.enabled(LogLevel::Trace)) {
+            log.write(LogLevel::Trace, msg);
+        }
+    });
+    run("log lines (lazy)", [&log](int i, const std::string& line) { LOG_TRACE(log, "Line {:08x}: {}", i, line); });
+    if (written != 0) {
+        fmt::print("{} messages got through a warn level logger\n", written);
+    }
+}
+
+/// Compare tracking which code has been decompiled as a set of addresses against an IntervalSet,
+/// for every function of a 10 MB .text section being decompiled in random order.
+static void benchCoverage() {
+    constexpr std::uint64_t TEXT_START = 0x401000;
+    constexpr std::uint64_t TEXT_SIZE = 10 * 1024 * 1024;
+    std::mt19937_64 rng(42);
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> functions{};
+    for (std::uint64_t addr = TEXT_START; addr < TEXT_START + TEXT_SIZE;) {
+        const std::uint64_t end = std::min(addr + 16 + rng() % 1024, TEXT_START + TEXT_SIZE);
+        functions.push_back({addr, end});
+        addr = end;
+    }
+    std::shuffle(functions.begin(), functions.end(), rng);
+    fmt::print("{} functions in {} bytes\n", functions.size(), TEXT_SIZE);
+
+    const auto run = [](const std::string& name, const std::function<std::size_t()>& fn) {
+        const std::size_t before = ALLOCATIONS;
+        const auto start = Clock::now();
+        const std::size_t result = fn();
+        const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        fmt::print("{:<32} {:>9} allocations  {:>8.1f}ms  ({})\n", name, ALLOCATIONS - before, ms, result);
+    };
+
+    std::unordered_set<std::uint64_t> addrs{};
+    run("set: decompile all", [&]() {
+        std::size_t seen = 0;
+        for (const auto& [start, end] : functions) {
+            for (std::uint64_t addr = start; addr < end; addr++) {
+                if (addrs.find(addr) != addrs.end()) {
+                    seen++;
+                    break;
+                }
+            }
+            for (std::uint64_t addr = start; addr < end; addr++) {
+                addrs.insert(addr);
+            }
+        }
+        return seen;
+    });
+    run("set: revisit all", [&]() {
+        std::size_t seen = 0;
+        for (const auto& [start, end] : functions) {
+            for (std::uint64_t addr = start; addr < end; addr++) {
+                if (addrs.find(addr) != addrs.end()) {
+                    seen++;
+                    break;
+                }
+            }
+        }
+        return seen;
+    });
+    run("set: invalidate half", [&]() {
+        for (std::size_t i = 0; i < functions.size(); i += 2) {
+            for (std::uint64_t addr = functions[i].first; addr < functions[i].second; addr++) {
+                addrs.erase(addr);
+            }
+        }
+        return addrs.size();
+    });
+    run("set: find gaps", [&]() {
+        std::size_t gaps = 0;
+        bool inGap = false;
+        for (std::uint64_t addr = TEXT_START; addr < TEXT_START + TEXT_SIZE; addr++) {
+            const bool covered = addrs.find(addr) != addrs.end();
+            gaps += !covered && !inGap;
+            inGap = !covered;
+        }
+        return gaps;
+    });
+
+    IntervalSet<std::uint64_t> intervals{};
+    run("intervals: decompile all", [&]() {
+        std::size_t seen = 0;
+        for (const auto& [start, end] : functions) {
+            seen += intervals.overlaps(start, end);
+            intervals.insert(start, end);
+        }
+        return seen;
+    });
+    run("intervals: revisit all", [&]() {
+        std::size_t seen = 0;
+        for (const auto& [start, end] : functions) {
+            seen += intervals.overlaps(start, end);
+        }
+        return seen;
+    });
+    run("intervals: invalidate half", [&]() {
+        for (std::size_t i = 0; i < functions.size(); i += 2) {
+            intervals.erase(functions[i].first, functions[i].second);
+        }
+        return intervals.intervals();
+    });
+    run("intervals: find gaps", [&]() {
+        std::size_t gaps = 0;
+        intervals.forEachGap(TEXT_START, TEXT_START + TEXT_SIZE, [&gaps](std::uint64_t, std::uint64_t) { gaps++; });
+        return gaps;
+    });
+}
+
+/// Check that every result of a batched lookup agrees with the same lookup made on its own.
+/// The batch spans several multicall requests, so chunking and reassembly are covered as well.
+static bool checkMulticall(Client& c) {
+    constexpr std::size_t LOOKUPS = 1000;
+    std::vector<std::size_t> addrs{};
+    for (std::size_t i = 0; i < LOOKUPS; i++) {
+        addrs.push_back(i * 7);
+    }
+    const auto results = c.queryDecompiledFunctions(addrs);
+    std::size_t matching = 0;
+    for (std::size_t i = 0; i < LOOKUPS; i++) {
+        const auto& r = results.at(i);
+        std::optional<DecompiledFunction> single{};
+        try {
+            single = c.queryDecompiledFunction(addrs[i]);
+        } catch (const std::exception&) {
+            // Failing both ways agrees too, e.g. outside of any function on a real server
+        }
+        bool same = !r.function && !single;
+        if (r.function && single) {
+            same = r.function->line_num == single->line_num && r.function->source == single->source;
+        }
+        if (r.addr == addrs[i] && same) {
+            matching++;
+        } else {
+            fmt::print("Batched lookup of {:x} differs from single one: {}\n", addrs[i], r.error);
+        }
+    }
+    fmt::print("multicall: {} of {} lookups match single calls\n", matching, LOOKUPS);
+    return matching == LOOKUPS;
+}
+
+/// Compare call latencies against a server.
+/// Returns whether batched lookups agree with single ones.
+static bool benchNetwork(const std::string& url, int iterations) {
+    // What the client did before connections were kept alive
+    measure("ping (connection per call)", iterations, [&](int) {
+        xmlrpc_c::clientSimple c{};
+        xmlrpc_c::value out;
+        c.call(url, "d2d.ping", &out);
+    });
+    measure("decompile (connection per call)", iterations, [&](int i) {
+        xmlrpc_c::clientSimple c{};
+        xmlrpc_c::value out;
+        c.call(url, "d2d.decompile", xmlrpc_c::paramList().add(xmlrpc_c::value_int(i)), &out);
+    });
+
+    Client c(url.c_str());
+    measure("ping (keep-alive)", iterations, [&](int) { c.ping(); });
+    measure("decompile (keep-alive)", iterations, [&](int i) { c.queryDecompiledFunction(i); });
+
+    // Pipelined, as done by the plugin. Reported per batch, as individual calls overlap.
+    for (const std::size_t inFlight : {1, 8, 32}) {
+        c.setMaxInFlight(inFlight);
+        measure(fmt::format("decompile x100 ({} in flight)", inFlight), iterations / 100 + 1, [&](int i) {
+            std::vector<std::future<DecompiledFunction>> futs{};
+            for (int j = 0; j < 100; j++) {
+                futs.push_back(c.queryDecompiledFunctionAsync(i * 100 + j));
+            }
+            for (auto& f : futs) {
+                f.get();
+            }
+        });
+    }
+
+    measure("decompile x100 (multicall)", iterations / 100 + 1, [&](int i) {
+        std::vector<std::size_t> addrs{};
+        for (int j = 0; j < 100; j++) {
+            addrs.push_back(i * 100 + j);
+        }
+        c.queryDecompiledFunctions(addrs);
+    });
+
+    // Bulk queries, with the whole response decoded at once vs. streamed
+    measure("function_headers (whole response)", iterations / 100 + 1, [&](int) { c.queryFunctionHeaders(); });
+    measure("function_headers (streamed)", iterations / 100 + 1, [&](int) {
+        std::size_t n = 0;
+        c.forEachFunctionHeader([&n](const Symbol&) { n++; });
+    });
+
+    const auto stats = c.wireStats();
+    fmt::print("Sent {} bytes as {} on the wire, received {} bytes as {} on the wire\n", stats.requestBytes,
+               stats.requestWireBytes, stats.responseBytes, stats.responseWireBytes);
+    fmt::print("{}", c.dumpMetrics());
+
+    return checkMulticall(c);
+}
+
+/// Make the same calls to a server without compression and to clientCompressingStandIn, serving the same data.
+/// Returns whether both decode to the same results, and compression saved bytes on the wire both ways.
+static bool benchCompression(const std::string& plainUrl, const std::string& compressedUrl) {
+    Client plain(plainUrl.c_str());
+    Client compressed(compressedUrl.c_str());
+    plain.ping();
+    compressed.ping();
+    if (!compressed.capabilities().compressedRequests) {
+        fmt::print("{} doesn't take compressed requests\n", compressedUrl);
+        return false;
+    }
+
+    std::vector<std::size_t> addrs{};
+    for (std::size_t i = 0; i < 1000; i++) {
+        addrs.push_back(i * 7);
+    }
+    const auto plainResults = plain.queryDecompiledFunctions(addrs);
+    const auto compressedResults = compressed.queryDecompiledFunctions(addrs);
+    std::size_t matching = 0;
+    for (std::size_t i = 0; i < addrs.size(); i++) {
+        const auto& a = plainResults.at(i);
+        const auto& b = compressedResults.at(i);
+        bool same = a.addr == b.addr && !a.function == !b.function;
+        if (same && a.function) {
+            same = a.function->line_num == b.function->line_num && a.function->source == b.function->source;
+        }
+        matching += same ? 1 : 0;
+    }
+    fmt::print("compression: {} of {} lookups decode the same\n", matching, addrs.size());
+
+    const auto plainHeaders = plain.queryFunctionHeaders();
+    const auto compressedHeaders = compressed.queryFunctionHeaders();
+    bool sameHeaders = plainHeaders.size() == compressedHeaders.size();
+    for (std::size_t i = 0; sameHeaders && i < plainHeaders.size(); i++) {
+        const auto& a = plainHeaders[i];
+        const auto& b = compressedHeaders[i];
+        sameHeaders = a.name == b.name && a.addr == b.addr && a.size == b.size;
+    }
+    fmt::print("compression: {} function headers decode {}\n", plainHeaders.size(),
+               sameHeaders ? "the same" : "differently");
+
+    const auto before = plain.wireStats();
+    const auto after = compressed.wireStats();
+    const auto saved = [](std::uint64_t bytes, std::uint64_t wire) {
+        return bytes == 0 ? 0.0 : 100.0 * (1.0 - static_cast<double>(wire) / static_cast<double>(bytes));
+    };
+    fmt::print("uncompressed: sent {} bytes as {} on the wire, received {} bytes as {} on the wire\n",
+               before.requestBytes, before.requestWireBytes, before.responseBytes, before.responseWireBytes);
+    fmt::print("compressed: sent {} bytes as {} on the wire ({:.1f}% saved), received {} bytes as {} ({:.1f}% saved)\n",
+               after.requestBytes, after.requestWireBytes, saved(after.requestBytes, after.requestWireBytes),
+               after.responseBytes, after.responseWireBytes, saved(after.responseBytes, after.responseWireBytes));
+    return matching == addrs.size() && sameHeaders && after.requestWireBytes < after.requestBytes &&
+           after.responseWireBytes < after.responseBytes;
+}
+
+/// The same client calls as over the network, but answered in-process,
+/// isolating serialization and decoding costs from the network.
+static void benchLoopback(int iterations) {
+    xmlrpc_c::registry reg;
+    registerStandInMethods(reg, 1000);
+    Client c(std::make_shared<LoopbackTransport>([&reg](const std::string& request) {
+        std::string response;
+        reg.processCall(request, &response);
+        return response;
+    }));
+
+    measure("loopback ping", iterations, [&c](int) { c.ping(); });
+    measure("loopback decompile", iterations, [&c](int i) { c.queryDecompiledFunction(i * 0x10); });
+    measure("loopback function_headers (whole)", iterations / 10, [&c](int) { c.queryFunctionHeaders(); });
+    measure("loopback function_headers (streamed)", iterations / 10, [&c](int) {
+        std::size_t n = 0;
+        c.forEachFunctionHeader([&n](const Symbol&) { n++; });
+    });
+    measure("loopback function_headers (paged)", iterations / 10, [&c](int) {
+        std::size_t n = 0;
+        c.forEachFunctionHeader(256, [&n](const std::vector<Symbol>& page) { n += page.size(); });
+    });
+    fmt::print("{}", c.dumpMetrics());
+}
+
+/// Replay a recorded session call by call, parsing every response like the client would.
+/// Then replay it once more on the timeline it was recorded on, with calls overlapping as they did back then.
+static void benchReplay(const std::string& path, ReplayTransport::Pacing pacing) {
+    ReplayTransport t(path, pacing);
+    const auto& exchanges = t.exchanges();
+    if (exchanges.empty()) {
+        fmt::print("{} holds no exchanges\n", path);
+        return;
+    }
+
+    std::chrono::nanoseconds recorded{0};
+    for (const auto& e : exchanges) {
+        recorded += e.duration;
+    }
+    measure("replay", static_cast<int>(exchanges.size()), [&t, &exchanges](int i) {
+        std::string response;
+        try {
+            t.roundTrip(
+                exchanges[i].request, [&response](const char* data, std::size_t len) { response.append(data, len); },
+                CallOptions());
+        } catch (const std::exception&) {
+            // Failed while recording as well
+            return;
+        }
+        xmlrpc_c::rpcOutcome outcome;
+        xmlrpc_c::xml::parseResponse(response, &outcome);
+    });
+    const auto stats = t.wireStats();
+    fmt::print("{} exchanges, {} bytes sent, {} bytes received, {:.1f}ms spent in calls while recording\n",
+               exchanges.size(), stats.requestBytes, stats.responseBytes,
+               std::chrono::duration<double, std::milli>(recorded).count());
+
+    // Again, but with calls overlapping as they did while recording
+    std::chrono::nanoseconds span{0};
+    std::size_t recordedFailures = 0;
+    for (const auto& e : exchanges) {
+        span = std::max(span, e.start + e.duration);
+        recordedFailures += e.error.empty() ? 0 : 1;
+    }
+    const auto start = Clock::now();
+    const auto results = replaySchedule(t, exchanges, [](std::size_t, const std::string& response) {
+        xmlrpc_c::rpcOutcome outcome;
+        xmlrpc_c::xml::parseResponse(response, &outcome);
+    });
+    const auto took = Clock::now() - start;
+    std::chrono::nanoseconds maxLateness{0};
+    std::size_t failures = 0;
+    for (const auto& r : results) {
+        maxLateness = std::max(maxLateness, r.lateness);
+        failures += r.error.empty() ? 0 : 1;
+    }
+    fmt::print("replay on the recorded timeline: {:.1f}ms, recorded {:.1f}ms, sent up to {:.2f}ms late, "
+               "{} failed, {} while recording\n",
+               std::chrono::duration<double, std::milli>(took).count(),
+               std::chrono::duration<double, std::milli>(span).count(),
+               std::chrono::duration<double, std::milli>(maxLateness).count(), failures, recordedFailures);
+}
+
+/// Spread decompile batches over several servers, with and without hedging, compared to using just the first.
+static void benchBalancing(const std::vector<std::string>& urls, std::chrono::milliseconds hedgeAfter,
+                           int iterations) {
+    const auto batch = [iterations](Client& c, const std::string& name) {
+        c.setMaxInFlight(32);
+        measure(name, iterations / 100 + 1, [&c](int i) {
+            std::vector<std::future<DecompiledFunction>> futs{};
+            for (int j = 0; j < 100; j++) {
+                futs.push_back(c.queryDecompiledFunctionAsync(i * 100 + j));
+            }
+            for (auto& f : futs) {
+                f.get();
+            }
+        });
+    };
+
+    Client single(urls.front().c_str());
+    batch(single, "decompile x100 (1 server)");
+
+    std::vector<std::shared_ptr<Transport>> endpoints{};
+    for (const auto& url : urls) {
+        endpoints.push_back(std::make_shared<HttpTransport>(url));
+    }
+    auto balanced = std::make_shared<BalancingTransport>(endpoints);
+    Client c(balanced);
+    batch(c, fmt::format("decompile x100 ({} servers)", urls.size()));
+    for (const auto& s : balanced->endpointStats()) {
+        fmt::print("  {} calls\n", s.calls);
+    }
+
+    auto hedged = std::make_shared<BalancingTransport>(endpoints, hedgeAfter);
+    Client h(hedged);
+    batch(h, fmt::format("decompile x100 (hedged >{}ms)", hedgeAfter.count()));
+    fmt::print("  {} calls hedged, {} answered first by the hedge\n", hedged->hedgedCalls(), hedged->hedgeWins());
+}
+
+/// Bulk queries over loopback HTTP and over shared memory, both served by stand-ins with the same symbols.
+static void benchSharedMemory(const std::string& channel, const std::string& url, int iterations) {
+    const auto run = [iterations](const std::shared_ptr<Transport>& t, const std::string& via) {
+        Client c(t);
+        const auto start = Clock::now();
+        measure(fmt::format("function_headers ({})", via), iterations, [&c](int) {
+            std::size_t n = 0;
+            c.forEachFunctionHeader([&n](const Symbol&) { n++; });
+        });
+        measure(fmt::format("global_vars ({})", via), iterations, [&c](int) {
+            std::size_t n = 0;
+            c.forEachGlobalVar([&n](const Symbol&) { n++; });
+        });
+        measure(fmt::format("decompile ({})", via), iterations * 10, [&c](int i) { c.queryDecompiledFunction(i); });
+        const double s = std::chrono::duration<double>(Clock::now() - start).count();
+        fmt::print("  {:.1f} MB/s received\n", static_cast<double>(t->wireStats().responseBytes) / s / 1e6);
+    };
+    run(std::make_shared<HttpTransport>(url), "http");
+    run(std::make_shared<SharedMemoryTransport>(channel), "shared memory");
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && std::string(argv[1]) == "decode") {
+        benchDecode();
+        benchLogging();
+        return 0;
+    }
+    if (argc == 2 && std::string(argv[1]) == "coverage") {
+        benchCoverage();
+        return 0;
+    }
+    if (argc >= 2 && argc <= 3 && std::string(argv[1]) == "loopback") {
+        benchLoopback(argc > 2 ? std::atoi(argv[2]) : 1000);
+        return 0;
+    }
+    if (argc >= 3 && argc <= 4 && std::string(argv[1]) == "replay") {
+        const bool paced = argc > 3 && std::string(argv[3]) == "paced";
+        benchReplay(argv[2], paced ? ReplayTransport::Pacing::AsRecorded : ReplayTransport::Pacing::AsFastAsPossible);
+        return 0;
+    }
+    if (argc >= 4 && argc <= 5 && std::string(argv[1]) == "shm") {
+        benchSharedMemory(argv[2], argv[3], argc > 4 ? std::atoi(argv[4]) : 100);
+        return 0;
+    }
+    if (argc == 4 && std::string(argv[1]) == "compression") {
+        return benchCompression(argv[2], argv[3]) ? 0 : 1;
+    }
+    if (argc >= 5 && std::string(argv[1]) == "balance") {
+        benchBalancing(std::vector<std::string>(argv + 3, argv + argc), std::chrono::milliseconds(std::atoi(argv[2])),
+                       1000);
+        return 0;
+    }
+    if (argc < 2 || argc > 3) {
+        fmt::print(
+            "Usage: {0} URL [iterations]\n       {0} loopback [iterations]\n       {0} replay CAPTURE [paced]\n"
+            "       {0} balance HEDGE_MS URL URL...\n       {0} shm CHANNEL URL [iterations]\n       {0} decode\n"
+            "       {0} coverage\n       {0} compression URL COMPRESSING_URL\n",
+            argv[0]);
+        return 1;
+    }
+    return benchNetwork(argv[1], argc > 2 ? std::atoi(argv[2]) : 1000) ? 0 : 1;
+}
@@ -0,0 +1,104 @@
+#include "cancellation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct CancellationToken::State {
+    std::atomic<bool> cancelled{false};
+    std::mutex lock;
+    std::size_t nextId = 0;
+    std::vector<std::pair<std::size_t, std::function<void()>>> callbacks;
+};
+
+CancellationToken::CancellationToken() : m_state(std::make_shared<State>()) {}
+
+void CancellationToken::cancel() const {
+    const auto g = std::lock_guard<std::mutex>(m_state->lock);
+    if (m_state->cancelled.exchange(true)) {
+        return;
+    }
+    for (const auto& [id, fn] : m_state->callbacks) {
+        fn();
+    }
+}
+
+bool CancellationToken::cancelled() const { return m_state->cancelled; }
+
+std::size_t CancellationToken::subscribe(std::function<void()> fn) const {
+    const auto g = std::lock_guard<std::mutex>(m_state->lock);
+    if (m_state->cancelled) {
+        fn();
+    }
+    const std::size_t id = m_state->nextId++;
+    m_state->callbacks.emplace_back(id, std::move(fn));
+    return id;
+}
+
+void CancellationToken::unsubscribe(std::size_t id) const {
+    const auto g = std::lock_guard<std::mutex>(m_state->lock);
+    auto& cbs = m_state->callbacks;
+    cbs.erase(std::remove_if(cbs.begin(), cbs.end(), [id](const auto& cb) { return cb.first == id; }), cbs.end());
+}
+
+CallOptions CallOptions::within(Clock::duration timeout) {
+    CallOptions opts{};
+    opts.deadline = Clock::now() + timeout;
+    return opts;
+}
+
+bool CallOptions::expired() const {
+    if (deadline && Clock::now() >= *deadline) {
+        return true;
+    }
+    return std::any_of(tokens.begin(), tokens.end(), [](const CancellationToken& t) { return t.cancelled(); });
+}
+
+void CallOptions::check() const {
+    if (deadline && Clock::now() >= *deadline) {
+        throw CancelledError("Call ran past its deadline");
+    }
+    for (const auto& t : tokens) {
+        if (t.cancelled()) {
+            throw CancelledError("Call was cancelled");
+        }
+    }
+}
+
+void CallOptions::sleepUntil(Clock::time_point until) const {
+    if (deadline && *deadline < until) {
+        until = *deadline;
+    }
+    std::mutex m;
+    std::condition_variable cv;
+    bool woken = false;
+    {
+        const CancellationWatch watch(*this, [&]() {
+            const auto g = std::lock_guard<std::mutex>(m);
+            woken = true;
+            cv.notify_all();
+        });
+        auto l = std::unique_lock<std::mutex>(m);
+        cv.wait_until(l, until, [&woken]() { return woken; });
+    }
+    check();
+}
+
+CancellationWatch::CancellationWatch(const CallOptions& opts, std::function<void()> onCancel) {
+    for (const auto& t : opts.tokens) {
+        m_subscriptions.emplace_back(t, t.subscribe(onCancel));
+    }
+}
+
+CancellationWatch::~CancellationWatch() {
+    for (const auto& [token, id] : m_subscriptions) {
+        token.unsubscribe(id);
+    }
+}
@@ -0,0 +1,275 @@
+#include "capture.h"
+
+#include <fmt/core.h>
+#include <lz4/lz4.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <numeric>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// Identifies capture files and their format version.
+static constexpr char MAGIC[8] = {'D', '2', 'D', 'C', 'A', 'P', '0', '2'};
+/// Length of the magic shared by all format versions.
+static constexpr std::size_t MAGIC_PREFIX = 6;
+/// Last byte of the magic of captures without errors.
+static constexpr char VERSION_WITHOUT_ERRORS = '1';
+/// Responses are handed out in pieces of this size, like curl does when receiving them.
+static constexpr std::size_t REPLAY_CHUNK_SIZE = 16 * 1024;
+
+static void putU32(std::string& out, std::uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+static void putU64(std::string& out, std::uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        out.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+/// Reads little endian integers and length prefixed strings out of a buffer, throwing when running past its end.
+class Reader {
+   public:
+    Reader(const char* data, std::size_t len) : m_data(data), m_len(len), m_pos(0) {}
+
+    std::uint64_t u64(int bytes = 8) {
+        need(bytes);
+        std::uint64_t v = 0;
+        for (int i = 0; i < bytes; i++) {
+            v |= static_cast<std::uint64_t>(static_cast<unsigned char>(m_data[m_pos + i])) << (8 * i);
+        }
+        m_pos += bytes;
+        return v;
+    }
+    std::uint32_t u32() { return static_cast<std::uint32_t>(u64(4)); }
+    const char* bytes(std::size_t len) {
+        need(len);
+        const char* p = m_data + m_pos;
+        m_pos += len;
+        return p;
+    }
+    std::string str() {
+        const std::size_t len = u32();
+        return std::string(bytes(len), len);
+    }
+    bool atEnd() const { return m_pos == m_len; }
+
+   private:
+    void need(std::size_t n) const {
+        if (m_len - m_pos < n) {
+            throw std::runtime_error("Capture record is truncated");
+        }
+    }
+
+    const char* m_data;
+    std::size_t m_len;
+    std::size_t m_pos;
+};
+
+RecordingTransport::RecordingTransport(std::shared_ptr<Transport> inner, const std::string& path)
+    : m_inner(std::move(inner)), m_epoch(std::chrono::steady_clock::now()), m_file(path, std::ios::binary) {
+    if (!m_file) {
+        throw std::runtime_error(fmt::format("Couldn't open capture file {}", path));
+    }
+    m_file.write(MAGIC, sizeof(MAGIC));
+}
+
+void RecordingTransport::roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) {
+    Exchange exchange{};
+    const auto start = std::chrono::steady_clock::now();
+    const auto record = [&](const char* data, std::size_t len) {
+        exchange.response.append(data, len);
+        onData(data, len);
+    };
+    std::exception_ptr error;
+    try {
+        m_inner->roundTrip(request, record, opts);
+    } catch (const std::exception& e) {
+        // Failures are part of the session too, e.g. timeouts of a struggling server
+        exchange.error = e.what();
+        error = std::current_exception();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    exchange.start = start - m_epoch;
+    exchange.duration = end - start;
+    exchange.request = request;
+    write(exchange);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void RecordingTransport::write(const Exchange& exchange) {
+    std::string raw;
+    raw.reserve(28 + exchange.request.size() + exchange.response.size() + exchange.error.size());
+    putU64(raw, exchange.start.count());
+    putU64(raw, exchange.duration.count());
+    putU32(raw, static_cast<std::uint32_t>(exchange.request.size()));
+    raw.append(exchange.request);
+    putU32(raw, static_cast<std::uint32_t>(exchange.response.size()));
+    raw.append(exchange.response);
+    putU32(raw, static_cast<std::uint32_t>(exchange.error.size()));
+    raw.append(exchange.error);
+    if (raw.size() > LZ4_MAX_INPUT_SIZE) {
+        throw std::runtime_error("Exchange too large to record");
+    }
+
+    std::string record;
+    putU32(record, static_cast<std::uint32_t>(raw.size()));
+    putU32(record, 0);  // Patched below, once known
+    record.resize(8 + LZ4_compressBound(static_cast<int>(raw.size())));
+    const int compressed = LZ4_compress(raw.data(), &record[8], static_cast<int>(raw.size()));
+    if (compressed <= 0) {
+        throw std::runtime_error("Failed to compress exchange");
+    }
+    record.resize(8 + compressed);
+    for (int i = 0; i < 4; i++) {
+        record[4 + i] = static_cast<char>((static_cast<std::uint32_t>(compressed) >> (8 * i)) & 0xff);
+    }
+
+    const auto g = std::lock_guard<std::mutex>(m_fileLock);
+    m_file.write(record.data(), static_cast<std::streamsize>(record.size()));
+    // Sessions tend to end with the debugger being closed, don't lose what was recorded up to then
+    m_file.flush();
+}
+
+WireStats RecordingTransport::wireStats() const { return m_inner->wireStats(); }
+
+void RecordingTransport::compressRequests() { m_inner->compressRequests(); }
+
+ReplayTransport::ReplayTransport(const std::string& path, Pacing pacing)
+    : m_pacing(pacing), m_requestBytes(0), m_responseBytes(0) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error(fmt::format("Couldn't open capture file {}", path));
+    }
+    const std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (contents.size() < sizeof(MAGIC) || std::memcmp(contents.data(), MAGIC, MAGIC_PREFIX) != 0) {
+        throw std::runtime_error(fmt::format("{} is not a capture file", path));
+    }
+    const char version = contents[sizeof(MAGIC) - 1];
+    if (version != MAGIC[sizeof(MAGIC) - 1] && version != VERSION_WITHOUT_ERRORS) {
+        throw std::runtime_error(fmt::format("{} is a capture file of an unknown version", path));
+    }
+
+    Reader records(contents.data() + sizeof(MAGIC), contents.size() - sizeof(MAGIC));
+    std::string raw;
+    while (!records.atEnd()) {
+        const std::uint32_t rawSize = records.u32();
+        const std::uint32_t compressedSize = records.u32();
+        const char* compressed = records.bytes(compressedSize);
+        if (rawSize > LZ4_MAX_INPUT_SIZE) {
+            throw std::runtime_error(fmt::format("Capture record {} is malformed", m_exchanges.size()));
+        }
+        raw.resize(rawSize);
+        const int decompressed = LZ4_decompress_safe(compressed, raw.data(), static_cast<int>(compressedSize),
+                                                     static_cast<int>(rawSize));
+        if (decompressed != static_cast<int>(rawSize)) {
+            throw std::runtime_error(fmt::format("Capture record {} is corrupt", m_exchanges.size()));
+        }
+
+        Reader fields(raw.data(), raw.size());
+        Exchange exchange{};
+        exchange.start = std::chrono::nanoseconds(fields.u64());
+        exchange.duration = std::chrono::nanoseconds(fields.u64());
+        exchange.request = fields.str();
+        exchange.response = fields.str();
+        if (version != VERSION_WITHOUT_ERRORS) {
+            exchange.error = fields.str();
+        }
+        m_byRequest[exchange.request].push_back(m_exchanges.size());
+        m_exchanges.push_back(std::move(exchange));
+    }
+}
+
+void ReplayTransport::roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) {
+    opts.check();
+    const auto start = std::chrono::steady_clock::now();
+    const auto it = m_byRequest.find(request);
+    if (it == m_byRequest.end()) {
+        throw std::runtime_error("Request was not recorded");
+    }
+    std::size_t n;
+    {
+        const auto g = std::lock_guard<std::mutex>(m_cursorLock);
+        n = m_cursors[request]++;
+    }
+    const Exchange& exchange = m_exchanges[it->second[n % it->second.size()]];
+
+    if (m_pacing == Pacing::AsRecorded) {
+        opts.sleepUntil(start + exchange.duration);
+    }
+    m_requestBytes += request.size();
+    m_responseBytes += exchange.response.size();
+    const std::string& response = exchange.response;
+    for (std::size_t pos = 0; pos < response.size(); pos += REPLAY_CHUNK_SIZE) {
+        onData(response.data() + pos, std::min(REPLAY_CHUNK_SIZE, response.size() - pos));
+    }
+    if (!exchange.error.empty()) {
+        throw std::runtime_error(exchange.error);
+    }
+}
+
+WireStats ReplayTransport::wireStats() const {
+    return WireStats{m_requestBytes, m_requestBytes, m_responseBytes, m_responseBytes};
+}
+
+const std::vector<Exchange>& ReplayTransport::exchanges() const { return m_exchanges; }
+
+std::vector<ReplayedExchange> replaySchedule(Transport& transport, const std::vector<Exchange>& exchanges,
+                                             const std::function<void(std::size_t, const std::string&)>& onResponse) {
+    // Exchanges are recorded in the order they completed, they're sent in the order they started
+    std::vector<std::size_t> order(exchanges.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&exchanges](std::size_t a, std::size_t b) { return exchanges[a].start < exchanges[b].start; });
+
+    std::vector<ReplayedExchange> results(exchanges.size());
+    std::vector<std::future<void>> inFlight{};
+    const auto epoch = std::chrono::steady_clock::now();
+    for (const std::size_t i : order) {
+        const auto due = epoch + exchanges[i].start;
+        std::this_thread::sleep_until(due);
+        // Reap what's done, so long sessions don't pile up finished threads
+        inFlight.erase(std::remove_if(inFlight.begin(), inFlight.end(),
+                                      [](const std::future<void>& f) {
+                                          return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                                      }),
+                       inFlight.end());
+        inFlight.push_back(std::async(std::launch::async, [&transport, &exchanges, &onResponse, &results, i, due]() {
+            ReplayedExchange& result = results[i];
+            const auto start = std::chrono::steady_clock::now();
+            result.lateness = start - due;
+            std::string response;
+            try {
+                const auto collect = [&response](const char* data, std::size_t len) { response.append(data, len); };
+                transport.roundTrip(exchanges[i].request, collect, CallOptions());
+                onResponse(i, response);
+            } catch (const std::exception& e) {
+                result.error = e.what();
+            }
+            result.duration = std::chrono::steady_clock::now() - start;
+        }));
+    }
+    for (auto& f : inFlight) {
+        f.get();
+    }
+    return results;
+}
@@ -0,0 +1,139 @@
+#include "circuit_breaker.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+CircuitBreakerTransport::CircuitBreakerTransport(std::shared_ptr<Transport> inner, std::string probeRequest,
+                                                 BreakerOptions options)
+    : m_inner(std::move(inner)),
+      m_probeRequest(std::move(probeRequest)),
+      m_options(options),
+      m_open(false),
+      m_failures(0),
+      m_backoff(options.initialBackoff),
+      m_trips(0),
+      m_rejected(0),
+      m_stopping(false) {
+    m_prober = std::thread([this]() { probeLoop(); });
+}
+
+CircuitBreakerTransport::~CircuitBreakerTransport() {
+    {
+        const auto g = std::lock_guard<std::mutex>(m_lock);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    m_stop.cancel();
+    m_prober.join();
+}
+
+void CircuitBreakerTransport::roundTrip(const std::string& request, const DataSink& onData,
+                                        const CallOptions& opts) {
+    {
+        const auto g = std::lock_guard<std::mutex>(m_lock);
+        if (m_open) {
+            m_rejected++;
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(m_retryAt -
+                                                                                    CallOptions::Clock::now());
+            throw UnavailableError(fmt::format("Decompiler server is unreachable, checking again in {}ms",
+                                               std::max(wait.count(), std::chrono::milliseconds::rep(0))));
+        }
+    }
+
+    // Anything going wrong once the server started answering isn't the server being down
+    bool answered = false;
+    try {
+        m_inner->roundTrip(
+            request,
+            [&answered, &onData](const char* data, std::size_t len) {
+                answered = true;
+                onData(data, len);
+            },
+            opts);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception&) {
+        if (!answered) {
+            recordFailure();
+        }
+        throw;
+    }
+
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    m_failures = 0;
+}
+
+void CircuitBreakerTransport::recordFailure() {
+    {
+        const auto g = std::lock_guard<std::mutex>(m_lock);
+        if (m_open || ++m_failures < m_options.failureThreshold) {
+            return;
+        }
+        m_open = true;
+        m_trips++;
+        m_backoff = m_options.initialBackoff;
+        m_retryAt = CallOptions::Clock::now() + m_backoff;
+    }
+    m_wake.notify_all();
+}
+
+void CircuitBreakerTransport::probeLoop() {
+    auto l = std::unique_lock<std::mutex>(m_lock);
+    while (!m_stopping) {
+        if (!m_open) {
+            m_wake.wait(l);
+            continue;
+        }
+        if (CallOptions::Clock::now() < m_retryAt) {
+            m_wake.wait_until(l, m_retryAt);
+            continue;
+        }
+
+        l.unlock();
+        bool up = true;
+        try {
+            CallOptions opts = CallOptions::within(m_options.probeTimeout);
+            opts.tokens.push_back(m_stop);
+            m_inner->roundTrip(m_probeRequest, [](const char*, std::size_t) {}, opts);
+        } catch (const std::exception&) {
+            up = false;
+        }
+        l.lock();
+
+        if (up) {
+            m_open = false;
+            m_failures = 0;
+        } else {
+            m_backoff = std::min(m_backoff * 2, m_options.maxBackoff);
+            m_retryAt = CallOptions::Clock::now() + m_backoff;
+        }
+    }
+}
+
+WireStats CircuitBreakerTransport::wireStats() const { return m_inner->wireStats(); }
+
+void CircuitBreakerTransport::compressRequests() { m_inner->compressRequests(); }
+
+bool CircuitBreakerTransport::available() const {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    return !m_open;
+}
+
+std::uint64_t CircuitBreakerTransport::trips() const {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    return m_trips;
+}
+
+std::uint64_t CircuitBreakerTransport::rejected() const {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    return m_rejected;
+}
@@ -3,528 +3,689 @@
 #include <fmt/core.h>
 #include <xmlrpc-c/base.h>
 
-#include <charconv>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <exception>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <xmlrpc-c/base.hpp>
-#include <xmlrpc-c/client_simple.hpp>
+#include <xmlrpc-c/xml.hpp>
 
-Client::Client(const char* endpoint_url) : m_verbose(false), m_url(endpoint_url) {
+#include "balancing.h"
+#include "circuit_breaker.h"
+#include "decode.h"
+#include "metrics.h"
+#include "single_flight.h"
+#include "stream_decoder.h"
+#include "transport.h"
+#include "value_view.h"
+#include "worker_pool.h"
+
+FaultError::FaultError(int code, const std::string& description)
+    : std::runtime_error(fmt::format("Server returned fault {}: {}", code, description)), m_code(code) {}
+
+int FaultError::code() const { return m_code; }
+
+std::shared_ptr<Transport> guardedHttpTransport(const std::string& url) {
+    std::string probe;
+    xmlrpc_c::xml::generateCall("d2d.ping", xmlrpc_c::paramList(), &probe);
+    return std::make_shared<CircuitBreakerTransport>(std::make_shared<HttpTransport>(url), probe);
+}
+
+Client::Client(const char* endpoint_url) : Client(guardedHttpTransport(endpoint_url)) {}
+
+/// One HTTP transport per URL, balanced between.
+static std::shared_ptr<Transport> balancedHttp(const std::vector<std::string>& urls,
+                                               std::optional<std::chrono::milliseconds> hedgeAfter) {
+    std::vector<std::shared_ptr<Transport>> endpoints{};
+    endpoints.reserve(urls.size());
+    for (const auto& url : urls) {
+        endpoints.push_back(guardedHttpTransport(url));
+    }
+    return std::make_shared<BalancingTransport>(std::move(endpoints), hedgeAfter);
+}
+
+Client::Client(const std::vector<std::string>& endpoint_urls, std::optional<std::chrono::milliseconds> hedgeAfter)
+    : Client(balancedHttp(endpoint_urls, hedgeAfter)) {}
+
+Client::Client(std::shared_ptr<Transport> transport)
+    : m_log("Client", LogLevel::Warn),
+      m_transport(std::move(transport)),
+      m_multicallUnsupported(false),
+      m_bulkDecompile(false),
+      m_inFlight(std::make_unique<SingleFlight<xmlrpc_c::value>>()),
+      m_metrics(std::make_unique<Metrics>()),
+      m_maxInFlight(8) {
     // Responses get really big
     xmlrpc_limit_set(XMLRPC_XML_SIZE_LIMIT_ID, 1024 * 1024 * 64);  // 64 MiB
 }
 
-void Client::logVerbosely() { m_verbose = true; }
+Client::~Client() = default;
+
+void Client::logVerbosely() { setLogLevel(LogLevel::Trace); }
+
+void Client::setLogLevel(LogLevel level) { m_log.setLevel(level); }
+
+void Client::setLogSink(Logger::Sink sink) { m_log.setSink(std::move(sink)); }
+
+WireStats Client::wireStats() const { return m_transport->wireStats(); }
+
+bool Client::serverAvailable() const { return m_transport->available(); }
+
+void Client::setMaxInFlight(std::size_t max) {
+    if (max == 0) {
+        throw std::invalid_argument("At least one call must be allowed in flight");
+    }
+    std::unique_ptr<WorkerPool> old;
+    {
+        const auto g = std::lock_guard<std::mutex>(m_workersLock);
+        m_maxInFlight = max;
+        old = std::move(m_workers);
+    }
+    // Outside the lock, as this waits for jobs queued on the old pool to finish
+    old.reset();
+}
+
+template <typename T>
+std::future<T> Client::submit(std::function<T()> fn) {
+    // std::function needs to be copyable, which packaged_task isn't
+    auto task = std::make_shared<std::packaged_task<T()>>(std::move(fn));
+    auto fut = task->get_future();
+    const auto g = std::lock_guard<std::mutex>(m_workersLock);
+    if (!m_workers) {
+        m_workers = std::make_unique<WorkerPool>(m_maxInFlight);
+    }
+    m_workers->submit([task]() { (*task)(); });
+    return fut;
+}
+
+template <typename T>
+std::vector<std::future<T>> Client::runConcurrently(std::vector<std::function<T()>> fns) {
+    auto tasks = std::make_shared<std::vector<std::packaged_task<T()>>>();
+    tasks->reserve(fns.size());
+    std::vector<std::future<T>> futs{};
+    futs.reserve(fns.size());
+    for (auto& fn : fns) {
+        tasks->emplace_back(std::move(fn));
+        futs.push_back(tasks->back().get_future());
+    }
+    // Whoever gets to a task first runs it, so none is left waiting behind a worker blocked on this call
+    auto next = std::make_shared<std::atomic<std::size_t>>(0);
+    const auto drain = [tasks, next]() {
+        for (std::size_t i = (*next)++; i < tasks->size(); i = (*next)++) {
+            (*tasks)[i]();
+        }
+    };
+    std::size_t helpers = 0;
+    {
+        const auto g = std::lock_guard<std::mutex>(m_workersLock);
+        // The calling thread counts towards the calls in flight as well
+        helpers = tasks->empty() ? 0 : std::min(tasks->size(), m_maxInFlight) - 1;
+    }
+    for (std::size_t i = 0; i < helpers; i++) {
+        submit<void>(drain);
+    }
+    drain();
+    return futs;
+}
+
+std::future<DecompiledFunction> Client::queryDecompiledFunctionAsync(std::size_t addr, const CallOptions& opts) {
+    // Bind the session now, so cancelAll() also drops calls still waiting in the queue
+    return submit<DecompiledFunction>(
+        [this, addr, opts = withSession(opts)]() { return queryDecompiledFunction(addr, opts); });
+}
+
+std::future<FunctionData> Client::queryFunctionDataAsync(std::size_t addr, const CallOptions& opts) {
+    return submit<FunctionData>([this, addr, opts = withSession(opts)]() { return queryFunctionData(addr, opts); });
+}
+
+CoalescingStats Client::coalescingStats() const {
+    return CoalescingStats{m_inFlight->calls(), m_inFlight->coalesced()};
+}
+
+std::vector<MethodMetrics> Client::metrics() const { return m_metrics->snapshot(); }
+
+std::string Client::dumpMetrics() const { return formatMetrics(m_metrics->snapshot()); }
+
+template <typename F>
+auto Client::timeDecode(const std::string& method, F&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        auto result = fn();
+        m_metrics->recordDecode(method, std::chrono::steady_clock::now() - start, false);
+        return result;
+    } catch (...) {
+        m_metrics->recordDecode(method, std::chrono::steady_clock::now() - start, true);
+        throw;
+    }
+}
+
+void Client::cancelAll() {
+    CancellationToken old;
+    {
+        const auto g = std::lock_guard<std::mutex>(m_sessionLock);
+        std::swap(old, m_session);
+    }
+    old.cancel();
+}
+
+CallOptions Client::withSession(const CallOptions& opts) {
+    CallOptions scoped = opts;
+    const auto g = std::lock_guard<std::mutex>(m_sessionLock);
+    scoped.tokens.push_back(m_session);
+    return scoped;
+}
+
+xmlrpc_c::value Client::call(const std::string& method, const xmlrpc_c::paramList& params, const CallOptions& opts) {
+    const CallOptions scoped = withSession(opts);
+    scoped.check();
+    std::string request;
+    xmlrpc_c::xml::generateCall(method, params, &request);
+
+    // The serialized request covers both method and parameters, so it's what identifies a call
+    return m_inFlight->run(request, scoped, [&]() {
+        std::string response;
+        const auto start = std::chrono::steady_clock::now();
+        try {
+            m_transport->roundTrip(
+                request, [&response](const char* data, std::size_t len) { response.append(data, len); }, scoped);
+        } catch (...) {
+            m_metrics->recordCall(method, std::chrono::steady_clock::now() - start, request.size(), response.size(),
+                                  true);
+            throw;
+        }
+        m_metrics->recordCall(method, std::chrono::steady_clock::now() - start, request.size(), response.size(),
+                              false);
+
+        return timeDecode(method, [&]() {
+            xmlrpc_c::rpcOutcome outcome;
+            xmlrpc_c::xml::parseResponse(response, &outcome);
+            if (!outcome.succeeded()) {
+                const auto fault = outcome.getFault();
+                throw FaultError(fault.getCode(), fault.getDescription());
+            }
+            return outcome.getResult();
+        });
+    });
+}
+
+void Client::callStreaming(const std::string& method, StreamDecoder& decoder, const CallOptions& opts) {
+    const CallOptions scoped = withSession(opts);
+    scoped.check();
+    std::string request;
+    xmlrpc_c::xml::generateCall(method, xmlrpc_c::paramList(), &request);
 
-void Client::log(const std::string& msg) {
-    if (m_verbose) {
-        fmt::print("[Client] {}\n", msg);
+    std::size_t received = 0;
+    std::chrono::nanoseconds decoding{0};
+    const auto feed = [&](const char* data, std::size_t len) {
+        const auto start = std::chrono::steady_clock::now();
+        received += len;
+        decoder.feed(data, len);
+        decoding += std::chrono::steady_clock::now() - start;
+    };
+    const auto start = std::chrono::steady_clock::now();
+    try {
+        m_transport->roundTrip(request, feed, scoped);
+        timeDecode(method, [&decoder]() {
+            decoder.finish();
+            return true;
+        });
+    } catch (...) {
+        m_metrics->recordCall(method, std::chrono::steady_clock::now() - start - decoding, request.size(), received,
+                              true);
+        throw;
     }
+    m_metrics->recordCall(method, std::chrono::steady_clock::now() - start - decoding, request.size(), received, false);
+    m_metrics->recordDecode(method, decoding, false);
 }
 
-void Client::ping() {
+void Client::forEachFunctionHeader(const std::function<void(const Symbol&)>& sink, const CallOptions& opts) {
     try {
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.ping", &out);
-        bool ok = xmlrpc_c::value_boolean(out.cValue()).cvalue();
+        // This is a map, where the function address is the key
+        StreamDecoder decoder({}, [&sink](const std::string& key, const StreamValue& v) {
+            sink(decodeSymbol(SymbolType::Function, key, v));
+        });
+        callStreaming("d2d.function_headers", decoder, opts);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Failed to query symbols: ") + e.what());
+    }
+}
+
+void Client::forEachGlobalVar(const std::function<void(const Symbol&)>& sink, const CallOptions& opts) {
+    LOG_DEBUG(m_log, "Streaming global variables");
+    try {
+        // This is a map, where the variable's address is the key
+        StreamDecoder decoder({}, [&sink](const std::string& key, const StreamValue& v) {
+            sink(decodeSymbol(SymbolType::Other, key, v));
+        });
+        callStreaming("d2d.global_vars", decoder, opts);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(std::string("Failed to query global variables: ") + e.what());
+    }
+}
+
+/// Collect records handed out one by one by `source` into pages for `sink`.
+template <typename T>
+static void collectPages(std::size_t pageSize, const std::function<void(const std::vector<T>&)>& sink,
+                         const std::function<void(const std::function<void(const T&)>&)>& source) {
+    if (pageSize == 0) {
+        throw std::invalid_argument("Pages must hold at least one record");
+    }
+    std::vector<T> page{};
+    page.reserve(pageSize);
+    source([&](const T& record) {
+        page.push_back(record);
+        if (page.size() == pageSize) {
+            sink(page);
+            page.clear();
+        }
+    });
+    if (!page.empty()) {
+        sink(page);
+    }
+}
+
+void Client::forEachFunctionHeader(std::size_t pageSize, const std::function<void(const std::vector<Symbol>&)>& sink,
+                                   const CallOptions& opts) {
+    collectPages<Symbol>(pageSize, sink, [&](const auto& each) { forEachFunctionHeader(each, opts); });
+}
+
+void Client::forEachGlobalVar(std::size_t pageSize, const std::function<void(const std::vector<Symbol>&)>& sink,
+                              const CallOptions& opts) {
+    collectPages<Symbol>(pageSize, sink, [&](const auto& each) { forEachGlobalVar(each, opts); });
+}
+
+void Client::forEachStruct(const std::function<void(const Structure&)>& sink, const CallOptions& opts) {
+    LOG_DEBUG(m_log, "Streaming structures...");
+    try {
+        StreamDecoder decoder({"struct_info"},
+                              [&sink](const std::string&, const StreamValue& v) { sink(decodeStructure(v)); });
+        callStreaming("d2d.structs", decoder, opts);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to query structures: {}", e.what()));
+    }
+}
+
+void Client::ping(const CallOptions& opts) {
+    try {
+        xmlrpc_c::value out = call("d2d.ping", xmlrpc_c::paramList(), opts);
+        bool ok = xmlrpc_c::value_boolean(out).cvalue();
         if (!ok) {
             throw std::runtime_error("Server responded with false");
         }
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(std::string("Failed to ping: ") + e.what());
     }
+
+    // The server may have been replaced by a different one since we last talked to it
+    {
+        const auto g = std::lock_guard<std::mutex>(m_capabilitiesLock);
+        m_capabilities.reset();
+    }
+    capabilities(opts);
 }
 
-std::vector<Symbol> Client::queryFunctionHeaders() {
+ServerCapabilities Client::capabilities(const CallOptions& opts) {
+    {
+        const auto g = std::lock_guard<std::mutex>(m_capabilitiesLock);
+        if (m_capabilities) {
+            return *m_capabilities;
+        }
+    }
+
+    // Not holding the lock, concurrent handshakes are coalesced into one anyway
+    ServerCapabilities caps{};
     try {
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.function_headers", &out);
-        std::vector<Symbol> symbols;
-        auto top_level = xmlrpc_c::value_struct(out.cValue()).cvalue();
-        // This is a map, where the function address is the key
-        for (const auto entry : top_level) {
-            auto mid_level = xmlrpc_c::value_struct(xmlrpc_c::value(entry.second).cValue()).cvalue();
-            // FIXME: This loses precision, convert directly to size_t
-            std::size_t func_addr;
-            // +2 to ignore the "0x" which from_chars can't parse
-            std::from_chars(entry.first.data() + 2, entry.first.data() + entry.first.size(), func_addr, 16);
-            std::string func_name = "";
-            std::size_t func_size = 0;
-
-            for (const auto entry2 : mid_level) {
-                auto name = entry2.first;
-                if (name == "name") {
-                    func_name =
-                        static_cast<std::string>(xmlrpc_c::value_string(xmlrpc_c::value(entry2.second).cValue()));
-                } else if (name == "size") {
-                    func_size =
-                        static_cast<std::size_t>(xmlrpc_c::value_int(xmlrpc_c::value(entry2.second).cValue()).cvalue());
-                } else {
-                    throw std::runtime_error(std::string("Failed to parse response: Unknown key ") + name);
-                }
+        caps = handshake(opts);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to discover server capabilities: {}", e.what()));
+    }
+    LOG_INFO(m_log,
+             "Server {} speaks protocol {}, multicall: {}, compressed requests: {}, bulk decompile: {}, revisions: {}",
+             caps.version, caps.protocol, caps.multicall, caps.compressedRequests, caps.bulkDecompile, caps.revisions);
+    m_multicallUnsupported = !caps.multicall;
+    m_bulkDecompile = caps.bulkDecompile;
+    if (caps.compressedRequests) {
+        m_transport->compressRequests();
+    }
+
+    const auto g = std::lock_guard<std::mutex>(m_capabilitiesLock);
+    m_capabilities = caps;
+    return caps;
+}
+
+ServerCapabilities Client::handshake(const CallOptions& opts) {
+    try {
+        xmlrpc_c::value out =
+            call("d2d.capabilities", xmlrpc_c::paramList().add(xmlrpc_c::value_int(PROTOCOL_VERSION)), opts);
+        return timeDecode("d2d.capabilities", [&]() { return decodeCapabilities(ValueRoot(out).view()); });
+    } catch (const FaultError& e) {
+        LOG_INFO(m_log, "Server predates d2d.capabilities, falling back to introspection: {}", e.what());
+    }
+
+    ServerCapabilities caps{"", 0, false, false, false, false};
+    try {
+        xmlrpc_c::value out = call("system.listMethods", xmlrpc_c::paramList(), opts);
+        ValueRoot(out).view().forEachItem([&caps](ValueView method) {
+            const std::string name = method.asString();
+            if (name == "system.multicall") {
+                caps.multicall = true;
+            } else if (name == "d2d.decompile_many") {
+                caps.bulkDecompile = true;
+            } else if (name == "d2d.revision") {
+                caps.revisions = true;
             }
-            Symbol s = {
-                .type = SymbolType::Function,
-                .name = func_name,
-                .addr = func_addr,
-                .size = func_size,
-            };
-            symbols.push_back(s);
-        }
-        return symbols;
+        });
+    } catch (const FaultError& e) {
+        // Nothing to go on, so optimistically try multicall, which falls back on its own if it turns out unsupported
+        LOG_INFO(m_log, "Server does not support introspection either: {}", e.what());
+        caps.multicall = true;
+    }
+    return caps;
+}
+
+std::int64_t Client::queryRevision(const CallOptions& opts) {
+    try {
+        xmlrpc_c::value out = call("d2d.revision", xmlrpc_c::paramList(), opts);
+        return ValueRoot(out).view().asInt();
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw std::runtime_error(fmt::format("Failed to query revision: {}", e.what()));
+    }
+}
+
+std::vector<Symbol> Client::queryFunctionHeaders(const CallOptions& opts) {
+    try {
+        xmlrpc_c::value out = call("d2d.function_headers", xmlrpc_c::paramList(), opts);
+        return timeDecode("d2d.function_headers",
+                          [&]() { return decodeSymbols(SymbolType::Function, ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(std::string("Failed to query symbols: ") + e.what());
     }
 }
 
-std::vector<Symbol> Client::queryGlobalVars() {
-    log("Querying global variables");
+std::vector<Symbol> Client::queryGlobalVars(const CallOptions& opts) {
+    LOG_DEBUG(m_log, "Querying global variables");
     try {
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.global_vars", &out);
-        std::vector<Symbol> symbols;
-        auto top_level = xmlrpc_c::value_struct(out.cValue()).cvalue();
-        // This is a map, where the variable's address is the key
-        for (const auto entry : top_level) {
-            log(fmt::format("Encountered top-level key: {}", entry.first).c_str());
-
-            auto var = xmlrpc_c::value_struct(xmlrpc_c::value(entry.second).cValue()).cvalue();
-            // FIXME: This loses precision, convert directly to size_t
-            std::size_t var_addr;
-            // +2 to ignore the "0x" which from_chars can't parse
-            std::from_chars(entry.first.data() + 2, entry.first.data() + entry.first.size(), var_addr, 16);
-            std::string var_name = "";
-            std::size_t var_size = 0;
-
-            for (const auto entry2 : var) {
-                auto key = entry2.first;
-                log(fmt::format("Encountered variable key: {}", key).c_str());
-                if (key == "name") {
-                    var_name =
-                        static_cast<std::string>(xmlrpc_c::value_string(xmlrpc_c::value(entry2.second).cValue()));
-                    log(fmt::format("Name: {}", var_name).c_str());
-                } else if (key == "size") {
-                    var_size =
-                        static_cast<std::size_t>(xmlrpc_c::value_int(xmlrpc_c::value(entry2.second).cValue()).cvalue());
-                } else {
-                    throw std::runtime_error(fmt::format("Failed to parse response: Unknown key {}", key));
-                }
-            }
-            Symbol s = {
-                .type = SymbolType::Other,
-                .name = var_name,
-                .addr = var_addr,
-                .size = var_size,
-            };
-            symbols.push_back(s);
-        }
-        log("Global variable query OK");
+        xmlrpc_c::value out = call("d2d.global_vars", xmlrpc_c::paramList(), opts);
+        auto symbols =
+            timeDecode("d2d.global_vars", [&]() { return decodeSymbols(SymbolType::Other, ValueRoot(out).view()); });
+        LOG_DEBUG(m_log, "Global variable query OK");
         return symbols;
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(std::string("Failed to query global variables: ") + e.what());
     }
 }
 
-DecompiledFunction Client::queryDecompiledFunction(std::size_t addr) {
+DecompiledFunction Client::queryDecompiledFunction(std::size_t addr, const CallOptions& opts) {
     try {
-        log("Querying decompiled functions...");
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.decompile", xmlrpc_c::paramList().add(xmlrpc_c::value_int(addr)), &out);
-        log("RPC call OK, processing...");
-
-        DecompiledFunction f{};
-        bool have_name = false;
-        bool have_source = false;
-        bool have_line_num = false;
-
-        auto top_level = xmlrpc_c::value_struct(out.cValue()).cvalue();
-        // This is a map, where the function address is the key
-        for (const auto entry : top_level) {
-            auto key = entry.first;
-            if (key == "curr_line") {
-                have_line_num = true;
-                // Line number
-                f.line_num = xmlrpc_c::value_int(xmlrpc_c::value(entry.second).cValue());
-                log(fmt::format("Line number for address: {}", f.line_num));
-            } else if (key == "decompilation") {
-                have_source = true;
-                // Decompiled source of the function, line-by-line
-                auto val = xmlrpc_c::value(entry.second).cValue();
-                for (const auto& decomp : xmlrpc_c::value_array(val).cvalue()) {
-                    auto decomp_line = static_cast<std::string>(xmlrpc_c::value_string(xmlrpc_c::value(decomp)));
-                    f.source.push_back(decomp_line);
-                    log(fmt::format("Source line: {}", decomp_line));
-                }
-            } else if (key == "func_name") {
-                have_name = true;
-                // Name of the function
-                auto val = xmlrpc_c::value(entry.second);
-                f.name = static_cast<std::string>(xmlrpc_c::value_string(val.cValue()));
-                log(fmt::format("Name of function: {}", f.name));
-            } else {
-                throw std::runtime_error("Encountered unexpected key: " + key);
-            }
-        }
-
-        if (have_name && have_line_num && have_source) {
-            log("Retrieving decompiler info complete");
-            return f;
-        } else {
-            throw std::runtime_error(
-                fmt::format("Missing required keys: have_name: {}, have_line_num: {}, have_source: {}", have_name,
-                            have_line_num, have_source));
-        }
+        LOG_DEBUG(m_log, "Querying decompiled functions...");
+        // Decompilations are what may keep a server busy for long, the only calls worth sending twice
+        CallOptions hedged = opts;
+        hedged.hedge = true;
+        xmlrpc_c::value out = call("d2d.decompile", xmlrpc_c::paramList().add(xmlrpc_c::value_int(addr)), hedged);
+        LOG_DEBUG(m_log, "RPC call OK, processing...");
+        return timeDecode("d2d.decompile", [&]() { return decodeDecompiledFunction(ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         std::string err = std::string("Failed to query function decompilation: ") + e.what();
         throw std::runtime_error(err);
     }
 }
 
-FunctionData Client::queryFunctionData(std::size_t addr) {
-    log("Querying function data...");
-    FunctionData fd{};
-    try {
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.function_data", xmlrpc_c::paramList().add(xmlrpc_c::value_int(addr)), &out);
-        log("RPC call OK, processing...");
-        auto top_level = xmlrpc_c::value_struct(out.cValue()).cvalue();
-        for (const auto entry : top_level) {
-            if (entry.first == "stack_vars") {
-                log("Found stack_vars, parsing...");
-                auto stack_vars = xmlrpc_c::value_struct(xmlrpc_c::value(entry.second).cValue()).cvalue();
-                for (const auto var : stack_vars) {
-                    StackVar sv;
-                    std::string var_offset = var.first;
-                    log(fmt::format("Stack variable offset: {}", var_offset));
-                    sv.offset = atoi(var_offset.c_str());
-
-                    auto fields = xmlrpc_c::value_struct(xmlrpc_c::value(var.second).cValue()).cvalue();
-                    for (const auto field : fields) {
-                        if (field.first == "name") {
-                            auto name = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                            log(fmt::format("Stack variable name: {}", name));
-                            sv.name = name;
-                        } else if (field.first == "type") {
-                            auto type = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                            log(fmt::format("Stack variable type: {}", type));
-                            sv.type = type;
-                        } else {
-                            throw std::runtime_error(
-                                fmt::format("Encountered unknown register variable field: {}", field.first));
-                        }
-                    }
-                    fd.stack_vars.push_back(sv);
+std::vector<DecompileResult> Client::queryDecompiledFunctions(const std::vector<std::size_t>& addrs,
+                                                             const CallOptions& opts) {
+    // Picks the fastest way the server supports
+    capabilities(opts);
+    if (m_bulkDecompile) {
+        try {
+            return queryDecompiledFunctionsBatched(addrs, opts, true);
+        } catch (const FaultError& e) {
+            LOG_INFO(m_log, "d2d.decompile_many failed, falling back to multicall: {}", e.what());
+            m_bulkDecompile = false;
+        }
+    }
+    if (!m_multicallUnsupported) {
+        try {
+            return queryDecompiledFunctionsBatched(addrs, opts, false);
+        } catch (const FaultError& e) {
+            // Fault on the multicall as a whole (rather than an entry) means the server can't do it
+            LOG_INFO(m_log, "Server does not support system.multicall, falling back to single calls: {}", e.what());
+            m_multicallUnsupported = true;
+        }
+    }
+
+    std::vector<std::function<DecompiledFunction()>> lookups{};
+    lookups.reserve(addrs.size());
+    for (const auto addr : addrs) {
+        // Bind the session now, so cancelAll() also drops lookups not started yet
+        lookups.push_back([this, addr, opts = withSession(opts)]() { return queryDecompiledFunction(addr, opts); });
+    }
+    auto futs = runConcurrently(std::move(lookups));
+    std::vector<DecompileResult> results{};
+    results.reserve(addrs.size());
+    for (std::size_t i = 0; i < addrs.size(); i++) {
+        DecompileResult r{addrs[i], std::nullopt, ""};
+        try {
+            r.function = futs[i].get();
+        } catch (const CancelledError&) {
+            // The whole batch is abandoned, not just this entry
+            throw;
+        } catch (const std::exception& e) {
+            r.error = e.what();
+        }
+        results.push_back(std::move(r));
+    }
+    return results;
+}
+
+std::vector<DecompileResult> Client::queryDecompiledFunctionsBatched(const std::vector<std::size_t>& addrs,
+                                                                    const CallOptions& opts, bool bulk) {
+    CallOptions scoped = withSession(opts);
+    // Batches of decompilations are as slow as their slowest entry, and small enough to send twice
+    scoped.hedge = true;
+    const std::string method = bulk ? "d2d.decompile_many" : "system.multicall";
+    // Chunks are sent concurrently over the worker pool
+    std::vector<std::function<std::vector<DecompileResult>()>> sends{};
+    for (std::size_t first = 0; first < addrs.size(); first += BATCH_CHUNK_SIZE) {
+        const std::size_t last = std::min(first + BATCH_CHUNK_SIZE, addrs.size());
+        std::vector<std::size_t> chunk(addrs.begin() + first, addrs.begin() + last);
+        sends.push_back([this, scoped, bulk, method, chunk = std::move(chunk)]() {
+            std::vector<xmlrpc_c::value> calls{};
+            calls.reserve(chunk.size());
+            for (const auto addr : chunk) {
+                if (bulk) {
+                    calls.push_back(xmlrpc_c::value_int(addr));
+                    continue;
                 }
-            } else if (entry.first == "reg_vars") {
-                log("Found reg_vars, parsing...");
-                auto reg_vars = xmlrpc_c::value_struct(xmlrpc_c::value(entry.second).cValue()).cvalue();
-                for (const auto var : reg_vars) {
-                    RegVar rv;
-                    std::string var_name = var.first;
-                    log(fmt::format("Register variable name: {}", var_name));
-                    rv.name = var_name;
-
-                    auto fields = xmlrpc_c::value_struct(xmlrpc_c::value(var.second).cValue()).cvalue();
-                    for (const auto field : fields) {
-                        if (field.first == "reg_name") {
-                            auto reg_name = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                            log(fmt::format("Register variable register name: {}", reg_name));
-                            rv.reg = reg_name;
-                        } else if (field.first == "type") {
-                            auto type = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                            log(fmt::format("Register variable type: {}", type));
-                            rv.type = type;
-                        } else {
-                            throw std::runtime_error(
-                                fmt::format("Encountered unknown register variable field: {}", field.first));
+                std::map<std::string, xmlrpc_c::value> c{
+                    {"methodName", xmlrpc_c::value_string("d2d.decompile")},
+                    // Spelled out, as a braced single value would pick value_array's converting constructor
+                    {"params", xmlrpc_c::value_array(std::vector<xmlrpc_c::value>{xmlrpc_c::value_int(addr)})},
+                };
+                calls.push_back(xmlrpc_c::value_struct(c));
+            }
+            LOG_DEBUG(m_log, "Sending {} with {} decompile requests", method, chunk.size());
+            auto out = call(method, xmlrpc_c::paramList().add(xmlrpc_c::value_array(calls)), scoped);
+
+            // Both answer in the same shape
+            return timeDecode(method, [&]() {
+                // Each entry is either a single-element array holding the result, or a fault struct
+                std::vector<DecompileResult> results{};
+                results.reserve(chunk.size());
+                ValueRoot root(out);
+                root.view().forEachItem([&](ValueView entry) {
+                    if (results.size() == chunk.size()) {
+                        throw std::runtime_error(fmt::format("{} returned more results than the {} calls made",
+                                                             method, chunk.size()));
+                    }
+                    DecompileResult r{chunk[results.size()], std::nullopt, ""};
+                    try {
+                        if (entry.type() == XMLRPC_TYPE_STRUCT) {
+                            std::string fault_string = "Unknown fault";
+                            entry.forEachMember([&fault_string](std::string_view key, ValueView value) {
+                                if (key == "faultString") {
+                                    fault_string = value.asString();
+                                }
+                            });
+                            throw std::runtime_error(fault_string);
                         }
+                        bool have_result = false;
+                        entry.forEachItem([&](ValueView result) {
+                            if (!have_result) {
+                                r.function = decodeDecompiledFunction(result);
+                                have_result = true;
+                            }
+                        });
+                        if (!have_result) {
+                            throw std::runtime_error("Empty batch result");
+                        }
+                    } catch (const std::exception& e) {
+                        r.error = fmt::format("Failed to query function decompilation: {}", e.what());
                     }
-                    fd.reg_vars.push_back(rv);
+                    results.push_back(std::move(r));
+                });
+                if (results.size() != chunk.size()) {
+                    throw std::runtime_error(
+                        fmt::format("{} returned {} results for {} calls", method, results.size(), chunk.size()));
                 }
-            } else {
-                throw std::runtime_error(fmt::format("Unknown top-level key: {}", entry.first));
-            }
-        }
+                return results;
+            });
+        });
+    }
+
+    std::vector<DecompileResult> results{};
+    results.reserve(addrs.size());
+    for (auto& chunk : runConcurrently(std::move(sends))) {
+        auto chunkResults = chunk.get();
+        std::move(chunkResults.begin(), chunkResults.end(), std::back_inserter(results));
+    }
+    return results;
+}
+
+DecompiledFunction Client::decodeDecompiledFunction(const ValueView& v) {
+    DecompiledFunction f = ::decodeDecompiledFunction(v);
+    LOG_DEBUG(m_log, "Name of function: {}", f.name);
+    LOG_TRACE(m_log, "Line number for address: {}", f.line_num);
+    for (const auto& line : f.source) {
+        LOG_TRACE(m_log, "Source line: {}", line);
+    }
+    LOG_TRACE(m_log, "Retrieving decompiler info complete");
+    return f;
+}
+
+FunctionData Client::queryFunctionData(std::size_t addr, const CallOptions& opts) {
+    LOG_DEBUG(m_log, "Querying function data...");
+    FunctionData fd{};
+    try {
+        xmlrpc_c::value out = call("d2d.function_data", xmlrpc_c::paramList().add(xmlrpc_c::value_int(addr)), opts);
+        LOG_DEBUG(m_log, "RPC call OK, processing...");
+        fd = timeDecode("d2d.function_data", [&]() { return decodeFunctionData(ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(fmt::format("Failed to query function data: {}", e.what()));
     }
 
-    log("Function info query done");
+    LOG_DEBUG(m_log, "Function info query done");
     return fd;
 }
 
-std::unordered_map<std::string, Structure> Client::queryStructs() {
-    log("Querying structures...");
+std::unordered_map<std::string, Structure> Client::queryStructs(const CallOptions& opts) {
+    LOG_DEBUG(m_log, "Querying structures...");
     std::unordered_map<std::string, Structure> structs{};
     try {
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.structs", &out);
-        log("RPC call OK, processing...");
-        auto top_level = xmlrpc_c::value_struct(out.cValue()).cvalue();
-        // Struct names are the keys
-        for (const auto entry : top_level) {
-            if (entry.first == "struct_info") {
-                log("Processing struct_info");
-                auto mid_level = xmlrpc_c::value_array(xmlrpc_c::value(entry.second).cValue()).cvalue();
-                for (const auto entry2 : mid_level) {
-                    Structure s;
-                    auto low_level = xmlrpc_c::value_struct(xmlrpc_c::value(entry2).cValue()).cvalue();
-                    for (const auto entry3 : low_level) {
-                        auto key = entry3.first;
-                        log(fmt::format("Structure key: {}", key));
-                        if (key == "name") {
-                            auto name = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(entry3.second).cValue()).cvalue());
-                            log(fmt::format("Structure name: {}", name));
-                            s.name = name;
-                        } else if (key == "members") {
-                            log("Parsing struct members");
-                            auto members = xmlrpc_c::value_array(entry3.second.cValue()).cvalue();
-                            for (const auto member : members) {
-                                StructureMember sm;
-                                auto member_xml = xmlrpc_c::value_struct(xmlrpc_c::value(member).cValue()).cvalue();
-                                for (const auto field : member_xml) {
-                                    log(fmt::format("Parsing structure Member field {}", field.first));
-                                    if (field.first == "name") {
-                                        auto name = static_cast<std::string>(
-                                            xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Structure member name: {}", name));
-                                        sm.name = name;
-                                    } else if (field.first == "type") {
-                                        auto type = static_cast<std::string>(
-                                            xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Structure member type: {}", type));
-                                        sm.type = type;
-                                    } else if (field.first == "size") {
-                                        auto size = static_cast<std::size_t>(
-                                            xmlrpc_c::value_int(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Structure member size: {}", size));
-                                        sm.size = size;
-                                    } else if (field.first == "offset") {
-                                        auto offset = static_cast<std::size_t>(
-                                            xmlrpc_c::value_int(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Structure member offset: {}", offset));
-                                        sm.offset = offset;
-                                    } else {
-                                        throw std::runtime_error(
-                                            fmt::format("Encountered unknown struct member field: {}", field.first));
-                                    }
-                                }
-                                s.members.push_back(sm);
-                            }
-                        } else {
-                            throw std::runtime_error(fmt::format("Unknown top-level key: {}", key));
-                        }
-                    }
-                    structs[s.name] = s;
-                }
-            }
-        }
+        xmlrpc_c::value out = call("d2d.structs", xmlrpc_c::paramList(), opts);
+        LOG_DEBUG(m_log, "RPC call OK, processing...");
+        structs = timeDecode("d2d.structs", [&]() { return decodeStructs(ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(fmt::format("Failed to query structures: {}", e.what()));
     }
 
-    log("Structure query done");
+    LOG_DEBUG(m_log, "Structure query done");
     return structs;
 }
 
-std::unordered_map<std::string, Union> Client::queryUnions() {
-    log("Querying unions...");
+std::unordered_map<std::string, Union> Client::queryUnions(const CallOptions& opts) {
+    LOG_DEBUG(m_log, "Querying unions...");
     std::unordered_map<std::string, Union> unions{};
     try {
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.unions", &out);
-        log("RPC call OK, processing...");
-        auto top_level = xmlrpc_c::value_struct(out.cValue()).cvalue();
-        for (const auto entry : top_level) {
-            if (entry.first == "union_info") {
-                log("Processing union_info");
-                auto mid_level = xmlrpc_c::value_array(xmlrpc_c::value(entry.second).cValue()).cvalue();
-                for (const auto entry2 : mid_level) {
-                    Union u;
-                    auto low_level = xmlrpc_c::value_struct(xmlrpc_c::value(entry2).cValue()).cvalue();
-                    for (const auto entry3 : low_level) {
-                        auto key = entry3.first;
-                        log(fmt::format("Union key: {}", key));
-                        if (key == "name") {
-                            auto name = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(entry3.second).cValue()).cvalue());
-                            log(fmt::format("Union name: {}", name));
-                            u.name = name;
-                        } else if (key == "members") {
-                            log("Parsing union members");
-                            auto members = xmlrpc_c::value_array(entry3.second.cValue()).cvalue();
-                            for (const auto member : members) {
-                                StructureMember sm;
-                                sm.offset = 0;
-                                auto member_xml = xmlrpc_c::value_struct(xmlrpc_c::value(member).cValue()).cvalue();
-                                for (const auto field : member_xml) {
-                                    log(fmt::format("Parsing union Member field {}", field.first));
-                                    if (field.first == "name") {
-                                        auto name = static_cast<std::string>(
-                                            xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Union member name: {}", name));
-                                        sm.name = name;
-                                    } else if (field.first == "size") {
-                                        auto size = static_cast<std::size_t>(
-                                            xmlrpc_c::value_int(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Union member size: {}", size));
-                                        sm.size = size;
-                                    } else if (field.first == "type") {
-                                        auto type = static_cast<std::string>(
-                                            xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Union member type: {}", type));
-                                        sm.type = type;
-                                    } else {
-                                        throw std::runtime_error(
-                                            fmt::format("Encountered unknown union member field: {}", field.first));
-                                    }
-                                }
-                                u.members.push_back(sm);
-                            }
-                        } else {
-                            throw std::runtime_error(fmt::format("Unknown top-level key: {}", key));
-                        }
-                    }
-                    unions[u.name] = u;
-                }
-            }
-        }
+        xmlrpc_c::value out = call("d2d.unions", xmlrpc_c::paramList(), opts);
+        LOG_DEBUG(m_log, "RPC call OK, processing...");
+        unions = timeDecode("d2d.unions", [&]() { return decodeUnions(ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(fmt::format("Failed to query unions: {}", e.what()));
     }
 
-    log("Union query done");
+    LOG_DEBUG(m_log, "Union query done");
     return unions;
 }
 
-std::unordered_map<std::string, TypeAlias> Client::queryTypeAliases() {
-    log("Querying type aliases...");
+std::unordered_map<std::string, TypeAlias> Client::queryTypeAliases(const CallOptions& opts) {
+    LOG_DEBUG(m_log, "Querying type aliases...");
     std::unordered_map<std::string, TypeAlias> aliases{};
     try {
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.type_aliases", &out);
-        log("RPC call OK, processing...");
-        auto top_level = xmlrpc_c::value_struct(out.cValue()).cvalue();
-        // Struct names are the keys
-        for (const auto entry : top_level) {
-            if (entry.first == "alias_info") {
-                log("Processing alias_info");
-                auto mid_level = xmlrpc_c::value_array(xmlrpc_c::value(entry.second).cValue()).cvalue();
-                for (const auto entry2 : mid_level) {
-                    TypeAlias a;
-                    auto low_level = xmlrpc_c::value_struct(xmlrpc_c::value(entry2).cValue()).cvalue();
-                    for (const auto entry3 : low_level) {
-                        auto key = entry3.first;
-                        log(fmt::format("Type alias key: {}", key));
-                        if (key == "name") {
-                            auto name = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(entry3.second).cValue()).cvalue());
-                            log(fmt::format("Type alias name: {}", name));
-                            a.name = name;
-                        } else if (key == "type") {
-                            auto type = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(entry3.second).cValue()).cvalue());
-                            log(fmt::format("Type alias type: {}", type));
-                            a.type = type;
-                        } else if (key == "size") {
-                            // Ignore for now
-                        } else {
-                            throw std::runtime_error(fmt::format("Unknown top-level key: {}", key));
-                        }
-                    }
-                    aliases[a.name] = a;
-                }
-            }
-        }
+        xmlrpc_c::value out = call("d2d.type_aliases", xmlrpc_c::paramList(), opts);
+        LOG_DEBUG(m_log, "RPC call OK, processing...");
+        aliases = timeDecode("d2d.type_aliases", [&]() { return decodeTypeAliases(ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(fmt::format("Failed to query type aliases: {}", e.what()));
     }
 
-    log("Type alias query done");
+    LOG_DEBUG(m_log, "Type alias query done");
     return aliases;
 }
 
-std::unordered_map<std::string, Enum> Client::queryEnums() {
-    log("Querying enums...");
+std::unordered_map<std::string, Enum> Client::queryEnums(const CallOptions& opts) {
+    LOG_DEBUG(m_log, "Querying enums...");
     std::unordered_map<std::string, Enum> enums{};
     try {
-        xmlrpc_c::clientSimple c{};
-        xmlrpc_c::value out;
-        c.call(m_url, "d2d.enums", &out);
-        log("RPC call OK, processing...");
-        auto top_level = xmlrpc_c::value_struct(out.cValue()).cvalue();
-        for (const auto entry : top_level) {
-            if (entry.first == "enum_info") {
-                log("Processing enum_info");
-                auto mid_level = xmlrpc_c::value_array(xmlrpc_c::value(entry.second).cValue()).cvalue();
-                for (const auto entry2 : mid_level) {
-                    Enum e;
-                    auto low_level = xmlrpc_c::value_struct(xmlrpc_c::value(entry2).cValue()).cvalue();
-                    for (const auto entry3 : low_level) {
-                        auto key = entry3.first;
-                        log(fmt::format("Enum key: {}", key));
-                        if (key == "name") {
-                            auto name = static_cast<std::string>(
-                                xmlrpc_c::value_string(xmlrpc_c::value(entry3.second).cValue()).cvalue());
-                            log(fmt::format("Enum name: {}", name));
-                            e.name = name;
-                        } else if (key == "members") {
-                            log("Parsing enum members");
-                            auto members = xmlrpc_c::value_array(entry3.second.cValue()).cvalue();
-                            for (const auto member : members) {
-                                EnumMember em;
-                                auto member_xml = xmlrpc_c::value_struct(xmlrpc_c::value(member).cValue()).cvalue();
-                                for (const auto field : member_xml) {
-                                    log(fmt::format("Parsing enum member field {}", field.first));
-                                    if (field.first == "name") {
-                                        auto name = static_cast<std::string>(
-                                            xmlrpc_c::value_string(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Enum member name: {}", name));
-                                        em.name = name;
-                                    } else if (field.first == "value") {
-                                        auto value = static_cast<std::size_t>(
-                                            xmlrpc_c::value_int(xmlrpc_c::value(field.second).cValue()).cvalue());
-                                        log(fmt::format("Enum member value: {}", value));
-                                        em.value = value;
-                                    } else {
-                                        throw std::runtime_error(
-                                            fmt::format("Encountered unknown enum member field: {}", field.first));
-                                    }
-                                }
-                                e.members.push_back(em);
-                            }
-                        } else {
-                            throw std::runtime_error(fmt::format("Unknown top-level key: {}", key));
-                        }
-                    }
-                    enums[e.name] = e;
-                }
-            }
-        }
+        xmlrpc_c::value out = call("d2d.enums", xmlrpc_c::paramList(), opts);
+        LOG_DEBUG(m_log, "RPC call OK, processing...");
+        enums = timeDecode("d2d.enums", [&]() { return decodeEnums(ValueRoot(out).view()); });
+    } catch (const CancelledError&) {
+        throw;
     } catch (const std::exception& e) {
         throw std::runtime_error(fmt::format("Failed to query enums: {}", e.what()));
     }
 
-    log("Enum query done");
+    LOG_DEBUG(m_log, "Enum query done");
     return enums;
-}
\ No newline at end of file
+}
@@ -0,0 +1,261 @@
+//! Stand-in for a decomp2dbg decompiler server like clientStandIn, which also speaks HTTP compression:
+//! it takes gzip or deflate compressed requests, and gzips responses for clients accepting that.
+//! The abyss server behind clientStandIn can do neither, so this speaks just as much HTTP as the client needs.
+
+#include <fmt/core.h>
+// Keep windows.h from clobbering std::min and std::max
+#define NOMINMAX
+#include <winsock2.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <xmlrpc-c/registry.hpp>
+
+#include "stand_in.h"
+
+/// Responses smaller than this are sent as they are, same cutoff as Python's XML-RPC server uses.
+static constexpr std::size_t MIN_COMPRESSED_SIZE = 1400;
+
+/// Largest request accepted, decompressed or not, same as the client's limit on responses.
+static constexpr std::size_t MAX_BODY_SIZE = 64 * 1024 * 1024;
+
+static std::string gzip(const std::string& data) {
+    z_stream zs{};
+    // 16 added to the window bits selects a gzip header instead of zlib's
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("Failed to initialize zlib");
+    }
+    std::string out(deflateBound(&zs, data.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    const int res = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (res != Z_STREAM_END) {
+        throw std::runtime_error("Failed to compress response");
+    }
+    out.resize(zs.total_out);
+    return out;
+}
+
+/// Decompress a gzip or zlib ("deflate" in HTTP terms) compressed body.
+static std::string inflateBody(const std::string& data) {
+    z_stream zs{};
+    // 32 added to the window bits detects either header
+    if (inflateInit2(&zs, 15 + 32) != Z_OK) {
+        throw std::runtime_error("Failed to initialize zlib");
+    }
+    std::string out;
+    char buf[64 * 1024];
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    int res = Z_OK;
+    while (res == Z_OK) {
+        zs.next_out = reinterpret_cast<Bytef*>(buf);
+        zs.avail_out = sizeof(buf);
+        res = inflate(&zs, Z_NO_FLUSH);
+        out.append(buf, sizeof(buf) - zs.avail_out);
+        if (out.size() > MAX_BODY_SIZE) {
+            res = Z_MEM_ERROR;
+        }
+    }
+    inflateEnd(&zs);
+    if (res != Z_STREAM_END) {
+        throw std::runtime_error(fmt::format("Failed to decompress request: zlib error {}", res));
+    }
+    return out;
+}
+
+static std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+/// A request as far as the stand-in cares.
+struct Request {
+    std::string body;
+    bool acceptsGzip;
+    bool keepAlive;
+};
+
+/// One client's connection, with whatever was received past the last request.
+class Connection {
+   public:
+    explicit Connection(SOCKET sock) : m_sock(sock) {}
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+    ~Connection() { closesocket(m_sock); }
+
+    /// Receive the next request, nullopt once the client hung up. Throws on requests the stand-in doesn't take.
+    std::optional<Request> receive() {
+        std::size_t headerEnd;
+        while ((headerEnd = m_buffer.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) {
+                return std::nullopt;
+            }
+        }
+        const std::string head = m_buffer.substr(0, headerEnd);
+        m_buffer.erase(0, headerEnd + 4);
+
+        const std::size_t lineEnd = head.find("\r\n");
+        const std::string requestLine = head.substr(0, lineEnd);
+        if (requestLine.rfind("POST ", 0) != 0) {
+            throw std::runtime_error(fmt::format("Unsupported request {}", requestLine));
+        }
+        Request req{"", false, requestLine.find("HTTP/1.0") == std::string::npos};
+        std::optional<std::size_t> length;
+        std::string encoding;
+        std::size_t pos = lineEnd;
+        while (pos != std::string::npos && pos < head.size()) {
+            const std::size_t start = pos + 2;
+            pos = head.find("\r\n", start);
+            const std::string line = head.substr(start, pos == std::string::npos ? std::string::npos : pos - start);
+            const std::size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                continue;
+            }
+            const std::size_t valueStart = std::min(line.find_first_not_of(' ', colon + 1), line.size());
+            const std::string name = lowercase(line.substr(0, colon));
+            const std::string value = lowercase(line.substr(valueStart));
+            if (name == "content-length") {
+                length = std::strtoull(value.c_str(), nullptr, 10);
+            } else if (name == "content-encoding") {
+                encoding = value;
+            } else if (name == "accept-encoding") {
+                req.acceptsGzip = value.find("gzip") != std::string::npos;
+            } else if (name == "connection") {
+                req.keepAlive = value != "close";
+            }
+        }
+        if (!length || *length > MAX_BODY_SIZE) {
+            throw std::runtime_error("Request without a Content-Length the stand-in takes");
+        }
+
+        while (m_buffer.size() < *length) {
+            if (!fill()) {
+                return std::nullopt;
+            }
+        }
+        req.body = m_buffer.substr(0, *length);
+        m_buffer.erase(0, *length);
+        if (encoding == "gzip" || encoding == "deflate") {
+            req.body = inflateBody(req.body);
+        } else if (!encoding.empty() && encoding != "identity") {
+            throw std::runtime_error(fmt::format("Unsupported content encoding {}", encoding));
+        }
+        return req;
+    }
+
+    void send(const std::string& data) {
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            const int chunk = static_cast<int>(std::min<std::size_t>(data.size() - sent, 1 << 20));
+            const int n = ::send(m_sock, data.data() + sent, chunk, 0);
+            if (n <= 0) {
+                throw std::runtime_error(fmt::format("Failed to send response: error {}", WSAGetLastError()));
+            }
+            sent += n;
+        }
+    }
+
+   private:
+    /// Receive more data into the buffer, false once the client hung up.
+    bool fill() {
+        char buf[64 * 1024];
+        const int n = recv(m_sock, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            return false;
+        }
+        m_buffer.append(buf, n);
+        return true;
+    }
+
+    SOCKET m_sock;
+    std::string m_buffer;
+};
+
+/// Answer requests on `sock` until the client is done with it.
+static void serve(SOCKET sock, const xmlrpc_c::registry& reg) {
+    Connection conn(sock);
+    try {
+        while (const auto req = conn.receive()) {
+            std::string response;
+            reg.processCall(req->body, &response);
+            const bool gzipped = req->acceptsGzip && response.size() >= MIN_COMPRESSED_SIZE;
+            if (gzipped) {
+                response = gzip(response);
+            }
+            conn.send(fmt::format("HTTP/1.1 200 OK\r\nContent-Type: text/xml\r\nContent-Length: {}\r\n{}{}\r\n",
+                                  response.size(), gzipped ? "Content-Encoding: gzip\r\n" : "",
+                                  req->keepAlive ? "" : "Connection: close\r\n"));
+            conn.send(response);
+            if (!req->keepAlive) {
+                return;
+            }
+        }
+    } catch (const std::exception& e) {
+        fmt::print("Dropping connection: {}\n", e.what());
+        try {
+            conn.send("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        } catch (const std::exception&) {
+            // Gone already
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 4) {
+        fmt::print("Usage: {} [port] [symbol count] [decompile delay ms]\n", argv[0]);
+        return 1;
+    }
+    const unsigned int port = argc > 1 ? std::atoi(argv[1]) : 3662;
+    const int symbols = argc > 2 ? std::atoi(argv[2]) : 1000;
+    const auto delay = std::chrono::milliseconds(argc > 3 ? std::atoi(argv[3]) : 0);
+
+    xmlrpc_c::registry reg;
+    registerStandInMethods(reg, symbols, delay, true);
+
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        fmt::print("Failed to initialize Winsock\n");
+        return 1;
+    }
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET) {
+        fmt::print("Failed to create socket: error {}\n", WSAGetLastError());
+        return 1;
+    }
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(static_cast<u_short>(port));
+    if (bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+        listen(listener, SOMAXCONN) == SOCKET_ERROR) {
+        fmt::print("Failed to listen on port {}: error {}\n", port, WSAGetLastError());
+        return 1;
+    }
+    fmt::print("Compressing stand-in server listening on port {} with {} symbols\n", port, symbols);
+
+    while (true) {
+        SOCKET sock = accept(listener, nullptr, nullptr);
+        if (sock == INVALID_SOCKET) {
+            continue;
+        }
+        // Responses go out in one piece, waiting for more to send along would only delay them
+        const int noDelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+        // Like abyss, a thread per connection, as the client keeps several open and reuses them
+        std::thread(serve, sock, std::cref(reg)).detach();
+    }
+}
@@ -0,0 +1,60 @@
+//! Demo of the coroutine API: fetches function data and decompilation of the first functions
+//! the server knows about, all concurrently from a single thread.
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "async_client.h"
+
+/// Everything fetched about a single function.
+struct FunctionSummary {
+    std::string name;
+    std::size_t stackVars;
+    std::size_t sourceLines;
+};
+
+static Task<std::size_t> countStackVars(AsyncClient& c, std::size_t addr) {
+    co_return (co_await c.queryFunctionData(addr)).stack_vars.size();
+}
+
+static Task<std::size_t> countSourceLines(AsyncClient& c, std::size_t addr) {
+    co_return (co_await c.queryDecompiledFunction(addr)).source.size();
+}
+
+static Task<FunctionSummary> summarize(AsyncClient& c, Symbol f) {
+    // Neither lookup depends on the other, so they go out together
+    std::vector<Task<std::size_t>> lookups{};
+    lookups.push_back(countStackVars(c, f.addr));
+    lookups.push_back(countSourceLines(c, f.addr));
+    const std::vector<std::size_t> counts = co_await whenAll(std::move(lookups));
+    co_return FunctionSummary{f.name, counts[0], counts[1]};
+}
+
+static Task<std::vector<FunctionSummary>> summarizeFirst(AsyncClient& c, std::size_t count) {
+    std::vector<Symbol> headers = co_await c.queryFunctionHeaders();
+    headers.resize(std::min(headers.size(), count));
+    std::vector<Task<FunctionSummary>> summaries{};
+    for (const auto& f : headers) {
+        summaries.push_back(summarize(c, f));
+    }
+    co_return co_await whenAll(std::move(summaries));
+}
+
+int main(int argc, char** argv) {
+    AsyncClient c(argc > 1 ? argv[1] : "http://localhost:3662/RPC2/");
+    const std::size_t count = argc > 2 ? std::atoi(argv[2]) : 20;
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto summaries = c.run(summarizeFirst(c, count));
+    const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    for (const auto& s : summaries) {
+        fmt::print("{:<40} {:>4} stack vars {:>6} lines\n", s.name, s.stackVars, s.sourceLines);
+    }
+    fmt::print("{} functions in {:.1f}ms\n", summaries.size(), ms);
+}
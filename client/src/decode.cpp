@@ -0,0 +1,196 @@
+#include "decode.h"
+
+#include <fmt/core.h>
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "client.h"
+#include "schema.h"
+#include "stream_decoder.h"
+#include "value_view.h"
+
+// Symbols are keyed by their address, which is filled in from the key
+template <>
+struct Schema<Symbol> {
+    static constexpr std::string_view NAME = "symbol";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS = std::make_tuple(field("name", &Symbol::name), field("size", &Symbol::size));
+};
+
+template <>
+struct Schema<StructureMember> {
+    static constexpr std::string_view NAME = "member";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS =
+        std::make_tuple(field("name", &StructureMember::name), field("type", &StructureMember::type),
+                        field("size", &StructureMember::size), field("offset", &StructureMember::offset));
+};
+
+template <>
+struct Schema<Structure> {
+    static constexpr std::string_view NAME = "struct";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS =
+        std::make_tuple(field("name", &Structure::name), field("members", &Structure::members));
+};
+
+template <>
+struct Schema<Union> {
+    static constexpr std::string_view NAME = "union";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS = std::make_tuple(field("name", &Union::name), field("members", &Union::members));
+};
+
+template <>
+struct Schema<TypeAlias> {
+    static constexpr std::string_view NAME = "type alias";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS =
+        std::make_tuple(field("name", &TypeAlias::name), field("type", &TypeAlias::type), ignoredField("size"));
+};
+
+template <>
+struct Schema<EnumMember> {
+    static constexpr std::string_view NAME = "enum member";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS =
+        std::make_tuple(field("name", &EnumMember::name), field("value", &EnumMember::value));
+};
+
+template <>
+struct Schema<Enum> {
+    static constexpr std::string_view NAME = "enum";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS = std::make_tuple(field("name", &Enum::name), field("members", &Enum::members));
+};
+
+// Keyed by stack offset
+template <>
+struct Schema<StackVar> {
+    static constexpr std::string_view NAME = "stack variable";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS = std::make_tuple(field("name", &StackVar::name), field("type", &StackVar::type));
+};
+
+// Keyed by variable name
+template <>
+struct Schema<RegVar> {
+    static constexpr std::string_view NAME = "register variable";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS = std::make_tuple(field("reg_name", &RegVar::reg), field("type", &RegVar::type));
+};
+
+template <>
+struct Schema<FunctionData> {
+    static constexpr std::string_view NAME = "function data";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS =
+        std::make_tuple(keyedField("stack_vars", &FunctionData::stack_vars, &StackVar::offset),
+                        keyedField("reg_vars", &FunctionData::reg_vars, &RegVar::name));
+};
+
+template <>
+struct Schema<DecompiledFunction> {
+    static constexpr std::string_view NAME = "decompilation";
+    static constexpr bool STRICT = true;
+    static constexpr auto FIELDS = std::make_tuple(requiredField("func_name", &DecompiledFunction::name),
+                                                   requiredField("decompilation", &DecompiledFunction::source),
+                                                   requiredField("curr_line", &DecompiledFunction::line_num));
+};
+
+/// Features are listed by name, each one sets a flag.
+struct SetFeatures {
+    template <typename V>
+    void operator()(ServerCapabilities& caps, const V& features) const {
+        features.forEachItem([&caps](const auto& feature) {
+            const std::string name = feature.asString();
+            if (name == "multicall") {
+                caps.multicall = true;
+            } else if (name == "compressed_requests") {
+                caps.compressedRequests = true;
+            } else if (name == "decompile_many") {
+                caps.bulkDecompile = true;
+            } else if (name == "revision") {
+                caps.revisions = true;
+            }
+        });
+    }
+};
+
+// Newer servers may report more than we know about, unlike elsewhere unknown keys aren't an error
+template <>
+struct Schema<ServerCapabilities> {
+    static constexpr std::string_view NAME = "capabilities";
+    static constexpr bool STRICT = false;
+    static constexpr auto FIELDS =
+        std::make_tuple(field("version", &ServerCapabilities::version),
+                        field("protocol", &ServerCapabilities::protocol), customField("features", SetFeatures{}));
+};
+
+template <typename V>
+Symbol decodeSymbol(SymbolType type, std::string_view key, const V& v) {
+    Symbol s = decodeRecord<Symbol>(v);
+    s.type = type;
+    s.addr = parseInteger<std::size_t>(key);
+    return s;
+}
+
+template <typename V>
+Structure decodeStructure(const V& v) {
+    return decodeRecord<Structure>(v);
+}
+
+template Symbol decodeSymbol<ValueView>(SymbolType, std::string_view, const ValueView&);
+template Symbol decodeSymbol<StreamValue>(SymbolType, std::string_view, const StreamValue&);
+template Structure decodeStructure<ValueView>(const ValueView&);
+template Structure decodeStructure<StreamValue>(const StreamValue&);
+
+/// Decode the records in the array under `key`, by name. Other keys are ignored.
+template <typename T>
+static std::unordered_map<std::string, T> decodeByName(ValueView v, std::string_view key) {
+    std::unordered_map<std::string, T> out{};
+    v.forEachMember([&out, key](std::string_view k, ValueView entry) {
+        if (k != key) {
+            return;
+        }
+        entry.forEachItem([&out](ValueView item) {
+            T decoded = decodeRecord<T>(item);
+            auto name = decoded.name;
+            out[std::move(name)] = std::move(decoded);
+        });
+    });
+    return out;
+}
+
+std::vector<Symbol> decodeSymbols(SymbolType type, ValueView v) {
+    std::vector<Symbol> symbols{};
+    // This is a map, where the symbol's address is the key
+    v.forEachMember(
+        [&](std::string_view key, ValueView entry) { symbols.push_back(decodeSymbol(type, key, entry)); });
+    return symbols;
+}
+
+std::unordered_map<std::string, Structure> decodeStructs(ValueView v) {
+    return decodeByName<Structure>(v, "struct_info");
+}
+
+std::unordered_map<std::string, Union> decodeUnions(ValueView v) { return decodeByName<Union>(v, "union_info"); }
+
+std::unordered_map<std::string, TypeAlias> decodeTypeAliases(ValueView v) {
+    return decodeByName<TypeAlias>(v, "alias_info");
+}
+
+std::unordered_map<std::string, Enum> decodeEnums(ValueView v) { return decodeByName<Enum>(v, "enum_info"); }
+
+FunctionData decodeFunctionData(ValueView v) { return decodeRecord<FunctionData>(v); }
+
+DecompiledFunction decodeDecompiledFunction(ValueView v) { return decodeRecord<DecompiledFunction>(v); }
+
+ServerCapabilities decodeCapabilities(ValueView v) { return decodeRecord<ServerCapabilities>(v); }
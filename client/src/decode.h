@@ -0,0 +1,31 @@
+#pragma once
+
+//! Decoders turning XML-RPC responses into the client's data types.
+//! These walk the value tree through views, without building intermediate copies of it.
+//! The layout of every record is described in one place, by its Schema in decode.cpp.
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "client.h"
+#include "value_view.h"
+
+/// Decode a function header or global variable, which is keyed by its address.
+/// Works on both ValueView and StreamValue.
+template <typename V>
+Symbol decodeSymbol(SymbolType type, std::string_view key, const V& v);
+/// Decode a single entry of the struct_info array.
+/// Works on both ValueView and StreamValue.
+template <typename V>
+Structure decodeStructure(const V& v);
+
+std::vector<Symbol> decodeSymbols(SymbolType type, ValueView v);
+std::unordered_map<std::string, Structure> decodeStructs(ValueView v);
+std::unordered_map<std::string, Union> decodeUnions(ValueView v);
+std::unordered_map<std::string, TypeAlias> decodeTypeAliases(ValueView v);
+std::unordered_map<std::string, Enum> decodeEnums(ValueView v);
+FunctionData decodeFunctionData(ValueView v);
+DecompiledFunction decodeDecompiledFunction(ValueView v);
+ServerCapabilities decodeCapabilities(ValueView v);
@@ -0,0 +1,231 @@
+#include "http.h"
+
+#include <curl/curl.h>
+#include <fmt/core.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+static std::once_flag CURL_INIT;
+
+/// Upper bound on how long a transfer waits for activity before checking on its deadline again.
+static constexpr int MAX_POLL_MS = 1000;
+
+/// How long connecting to the server may take. The server is usually local, so anything longer means it isn't up,
+/// and the caller is better off finding out well before its deadline.
+static constexpr long CONNECT_TIMEOUT_MS = 3000;
+
+/// Request bodies smaller than this aren't worth compressing, same cutoff as Python's XML-RPC server uses.
+static constexpr std::size_t MIN_COMPRESSED_SIZE = 1400;
+
+static std::string gzip(const std::string& data) {
+    z_stream zs{};
+    // 16 added to the window bits selects a gzip header instead of zlib's
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw std::runtime_error("Failed to initialize zlib");
+    }
+    std::string out(deflateBound(&zs, data.size()), '\0');
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+    zs.avail_in = static_cast<uInt>(data.size());
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = static_cast<uInt>(out.size());
+    const int res = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (res != Z_STREAM_END) {
+        throw std::runtime_error("Failed to compress request");
+    }
+    out.resize(zs.total_out);
+    return out;
+}
+
+/// State shared with the curl write callback during a transfer.
+struct Transfer {
+    CURL* curl;
+    const HttpConnection::DataSink* onData;
+    long status;
+    std::size_t received;
+    std::exception_ptr error;
+};
+
+static std::size_t forwardData(char* data, std::size_t size, std::size_t nmemb, void* userdata) {
+    auto t = static_cast<Transfer*>(userdata);
+    // Don't feed error pages to the caller
+    if (t->status == 0) {
+        curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &t->status);
+    }
+    if (t->status != 200) {
+        return 0;
+    }
+    t->received += size * nmemb;
+    // Exceptions must not unwind through curl
+    try {
+        (*t->onData)(data, size * nmemb);
+    } catch (...) {
+        t->error = std::current_exception();
+        return 0;
+    }
+    return size * nmemb;
+}
+
+HttpConnection::HttpConnection(const std::string& url)
+    : m_curl(nullptr),
+      m_multi(nullptr),
+      m_headers(nullptr),
+      m_gzipHeaders(nullptr),
+      m_stats{0, 0, 0, 0},
+      m_kept(false),
+      m_reused(false),
+      m_url(url) {
+    std::call_once(CURL_INIT, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+    m_curl = curl_easy_init();
+    if (m_curl == nullptr) {
+        throw std::runtime_error("Failed to create curl handle");
+    }
+    m_multi = curl_multi_init();
+    if (m_multi == nullptr) {
+        curl_easy_cleanup(m_curl);
+        throw std::runtime_error("Failed to create curl multi handle");
+    }
+    m_errbuf[0] = '\0';
+
+    m_headers = curl_slist_append(m_headers, "Content-Type: text/xml");
+    // Otherwise curl waits for a "100 Continue" on larger bodies, which costs a round trip
+    m_headers = curl_slist_append(m_headers, "Expect:");
+    m_gzipHeaders = curl_slist_append(m_gzipHeaders, "Content-Type: text/xml");
+    m_gzipHeaders = curl_slist_append(m_gzipHeaders, "Expect:");
+    m_gzipHeaders = curl_slist_append(m_gzipHeaders, "Content-Encoding: gzip");
+
+    curl_easy_setopt(m_curl, CURLOPT_URL, m_url.c_str());
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_headers);
+    curl_easy_setopt(m_curl, CURLOPT_ERRORBUFFER, m_errbuf);
+    curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, forwardData);
+    // Decompiler output is highly redundant text, curl decompresses it for us
+    curl_easy_setopt(m_curl, CURLOPT_ACCEPT_ENCODING, "gzip, deflate");
+    // Signals don't mix with the debugger's threads
+    curl_easy_setopt(m_curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(m_curl, CURLOPT_TCP_NODELAY, 1L);
+    curl_easy_setopt(m_curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT_MS, CONNECT_TIMEOUT_MS);
+}
+
+HttpConnection::~HttpConnection() {
+    curl_multi_cleanup(m_multi);
+    curl_easy_cleanup(m_curl);
+    curl_slist_free_all(m_headers);
+    curl_slist_free_all(m_gzipHeaders);
+}
+
+const TransferStats& HttpConnection::lastTransfer() const { return m_stats; }
+
+bool HttpConnection::reusedConnection() const { return m_reused; }
+
+/// Whether a transfer failed with `res` before it got connected to the server.
+static bool failedToConnect(CURL* curl, CURLcode res) {
+    if (res == CURLE_COULDNT_RESOLVE_HOST || res == CURLE_COULDNT_CONNECT) {
+        return true;
+    }
+    curl_off_t connectTime = 0;
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connectTime);
+    return res == CURLE_OPERATION_TIMEDOUT && connectTime == 0;
+}
+
+CURLcode HttpConnection::perform(const CallOptions& opts) {
+    if (curl_multi_add_handle(m_multi, m_curl) != CURLM_OK) {
+        throw std::runtime_error("Failed to start HTTP request");
+    }
+    // Cancellation interrupts the wait for socket activity right away
+    const CancellationWatch watch(opts, [multi = m_multi]() { curl_multi_wakeup(multi); });
+
+    bool abandoned = false;
+    CURLMcode mres = CURLM_OK;
+    int running = 1;
+    while (running > 0) {
+        mres = curl_multi_perform(m_multi, &running);
+        if (mres != CURLM_OK || running == 0) {
+            break;
+        }
+        if (opts.expired()) {
+            abandoned = true;
+            break;
+        }
+        int timeoutMs = MAX_POLL_MS;
+        if (opts.deadline) {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(*opts.deadline - CallOptions::Clock::now());
+            timeoutMs = static_cast<int>(std::clamp<long long>(left.count(), 0, MAX_POLL_MS));
+        }
+        curl_multi_poll(m_multi, nullptr, 0, timeoutMs, nullptr);
+    }
+
+    CURLcode res = CURLE_ABORTED_BY_CALLBACK;
+    int pending = 0;
+    while (CURLMsg* msg = curl_multi_info_read(m_multi, &pending)) {
+        if (msg->msg == CURLMSG_DONE && msg->easy_handle == m_curl) {
+            res = msg->data.result;
+        }
+    }
+    // Removing an unfinished transfer closes its connection, the next request opens a fresh one
+    curl_multi_remove_handle(m_multi, m_curl);
+    if (abandoned) {
+        opts.check();
+    }
+    if (mres != CURLM_OK) {
+        throw std::runtime_error(fmt::format("HTTP request to {} failed: {}", m_url, curl_multi_strerror(mres)));
+    }
+    return res;
+}
+
+std::string HttpConnection::post(const std::string& body, bool compress, const CallOptions& opts) {
+    std::string response;
+    post(body, [&response](const char* data, std::size_t len) { response.append(data, len); }, compress, opts);
+    return response;
+}
+
+void HttpConnection::post(const std::string& body, const DataSink& onData, bool compress, const CallOptions& opts) {
+    opts.check();
+    Transfer t{m_curl, &onData, 0, 0, nullptr};
+    m_errbuf[0] = '\0';
+    // Only known to be kept alive again once this transfer succeeds
+    m_reused = m_kept;
+    m_kept = false;
+
+    std::string compressed;
+    const bool gzipped = compress && body.size() >= MIN_COMPRESSED_SIZE;
+    if (gzipped) {
+        compressed = gzip(body);
+    }
+    const std::string& sent = gzipped ? compressed : body;
+    curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, gzipped ? m_gzipHeaders : m_headers);
+    curl_easy_setopt(m_curl, CURLOPT_POSTFIELDS, sent.data());
+    curl_easy_setopt(m_curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(sent.size()));
+    curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &t);
+
+    const CURLcode res = perform(opts);
+    // Connecting anew failed, e.g. as curl found the kept alive connection closed, so nothing was sent over it
+    if (failedToConnect(m_curl, res)) {
+        m_reused = false;
+    }
+    curl_off_t downloaded = 0;
+    curl_easy_getinfo(m_curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+    m_stats = TransferStats{body.size(), sent.size(), t.received, static_cast<std::size_t>(downloaded)};
+    if (t.error) {
+        std::rethrow_exception(t.error);
+    }
+    if (t.status == 0) {
+        curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &t.status);
+    }
+    if (res != CURLE_OK && (t.status == 0 || t.status == 200)) {
+        throw std::runtime_error(fmt::format("HTTP request to {} failed: {}", m_url,
+                                             m_errbuf[0] != '\0' ? m_errbuf : curl_easy_strerror(res)));
+    }
+    if (t.status != 200) {
+        throw std::runtime_error(fmt::format("HTTP request to {} failed with status {}", m_url, t.status));
+    }
+    m_kept = true;
+}
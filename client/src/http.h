@@ -0,0 +1,64 @@
+#pragma once
+
+//! Minimal persistent HTTP connection for talking XML-RPC, built directly on libcurl.
+
+#include <curl/curl.h>
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#include "cancellation.h"
+
+/// Sizes of the last transfer, both as sent over the wire and after (de)compression.
+struct TransferStats {
+    std::size_t requestBytes;
+    std::size_t requestWireBytes;
+    std::size_t responseBytes;
+    std::size_t responseWireBytes;
+};
+
+/// A single libcurl easy handle bound to one endpoint.
+/// Transfers are driven through a private multi handle, so they can be woken up and aborted when cancelled.
+/// The handle is kept alive between requests, so curl can reuse the underlying
+/// TCP connection (HTTP keep-alive) instead of doing a fresh handshake per call.
+/// Responses are requested gzip or deflate compressed, and decompressed transparently.
+/// Not thread-safe, callers must ensure only one thread uses a connection at a time.
+class HttpConnection {
+   public:
+    HttpConnection() = delete;
+    explicit HttpConnection(const std::string& url);
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+    ~HttpConnection();
+
+    using DataSink = std::function<void(const char* data, std::size_t len)>;
+
+    /// POST the given XML body and return the response body.
+    /// If `compress` is set, bodies large enough to benefit are sent gzip-compressed.
+    std::string post(const std::string& body, bool compress = false, const CallOptions& opts = CallOptions());
+    /// POST the given XML body, handing the response body to `onData` piece by piece as it arrives.
+    /// Exceptions thrown by `onData` abort the transfer and are rethrown.
+    /// Throws CancelledError as soon as `opts` say so, the connection is not reusable after that.
+    void post(const std::string& body, const DataSink& onData, bool compress = false,
+              const CallOptions& opts = CallOptions());
+    const TransferStats& lastTransfer() const;
+    /// Whether the last transfer, successful or not, was attempted over a connection kept alive from an earlier one,
+    /// rather than over a new connection or with connecting failing.
+    bool reusedConnection() const;
+
+   private:
+    /// Run the prepared transfer to completion, unless `opts` say to abandon it.
+    CURLcode perform(const CallOptions& opts);
+
+    CURL* m_curl;
+    CURLM* m_multi;
+    curl_slist* m_headers;
+    curl_slist* m_gzipHeaders;
+    TransferStats m_stats;
+    // Whether the last transfer succeeded, so curl keeps its connection alive for the next one
+    bool m_kept;
+    bool m_reused;
+    std::string m_url;
+    char m_errbuf[CURL_ERROR_SIZE];
+};
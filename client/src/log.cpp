@@ -0,0 +1,45 @@
+#include "log.h"
+
+#include <fmt/core.h>
+
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+static constexpr std::array<const char*, 6> LEVEL_NAMES = {"trace", "debug", "info", "warn", "error", "off"};
+
+const char* logLevelName(LogLevel level) { return LEVEL_NAMES.at(static_cast<std::size_t>(level)); }
+
+std::optional<LogLevel> parseLogLevel(std::string_view name) {
+    for (std::size_t i = 0; i < LEVEL_NAMES.size(); i++) {
+        if (name == LEVEL_NAMES[i]) {
+            return static_cast<LogLevel>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+Logger::Logger(std::string component, LogLevel level)
+    : Logger(level, [component = std::move(component)](LogLevel, const std::string& msg) {
+          fmt::print("[{}] {}\n", component, msg);
+      }) {}
+
+Logger::Logger(LogLevel level, Sink sink) : m_level(level), m_sink(std::move(sink)) {}
+
+LogLevel Logger::level() const { return m_level; }
+
+void Logger::setLevel(LogLevel level) { m_level = level; }
+
+void Logger::setSink(Sink sink) {
+    const auto g = std::lock_guard<std::mutex>(m_sinkLock);
+    m_sink = std::move(sink);
+}
+
+void Logger::write(LogLevel level, const std::string& msg) const {
+    const auto g = std::lock_guard<std::mutex>(m_sinkLock);
+    m_sink(level, msg);
+}
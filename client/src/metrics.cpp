@@ -0,0 +1,110 @@
+#include "metrics.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+LatencyHistogram::LatencyHistogram() : m_buckets{}, m_count(0) {}
+
+std::size_t LatencyHistogram::bucketOf(std::uint64_t us) {
+    // Small values get a bucket each
+    if (us < SUB_BUCKETS) {
+        return static_cast<std::size_t>(us);
+    }
+    int exponent = 0;
+    while ((us >> exponent) >= 2 * SUB_BUCKETS) {
+        exponent++;
+    }
+    // Value is now in [SUB_BUCKETS, 2 * SUB_BUCKETS) after shifting, its low bits pick the sub-bucket
+    const std::size_t bucket = SUB_BUCKETS * (exponent + 1) + ((us >> exponent) - SUB_BUCKETS);
+    return std::min(bucket, BUCKETS - 1);
+}
+
+std::uint64_t LatencyHistogram::upperBoundOf(std::size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket + 1;
+    }
+    const std::size_t exponent = bucket / SUB_BUCKETS - 1;
+    const std::uint64_t base = SUB_BUCKETS + bucket % SUB_BUCKETS;
+    return (base + 1) << exponent;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds d) {
+    const auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+    m_buckets[bucketOf(us < 0 ? 0 : static_cast<std::uint64_t>(us))]++;
+    m_count++;
+}
+
+std::chrono::nanoseconds LatencyHistogram::percentile(double p) const {
+    if (m_count == 0) {
+        return std::chrono::nanoseconds(0);
+    }
+    const auto rank = static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(m_count)));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKETS; i++) {
+        seen += m_buckets[i];
+        if (seen >= std::max<std::uint64_t>(rank, 1)) {
+            return std::chrono::microseconds(upperBoundOf(i));
+        }
+    }
+    return std::chrono::microseconds(upperBoundOf(BUCKETS - 1));
+}
+
+std::uint64_t LatencyHistogram::count() const { return m_count; }
+
+void Metrics::recordCall(const std::string& method, std::chrono::nanoseconds latency, std::size_t requestBytes,
+                         std::size_t responseBytes, bool failed) {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    auto& e = m_methods[method];
+    e.calls++;
+    e.errors += failed ? 1 : 0;
+    e.requestBytes += requestBytes;
+    e.responseBytes += responseBytes;
+    e.latency.record(latency);
+}
+
+void Metrics::recordDecode(const std::string& method, std::chrono::nanoseconds duration, bool failed) {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    auto& e = m_methods[method];
+    e.errors += failed ? 1 : 0;
+    e.decodeTime += duration;
+}
+
+std::vector<MethodMetrics> Metrics::snapshot() const {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    std::vector<MethodMetrics> out{};
+    out.reserve(m_methods.size());
+    for (const auto& [method, e] : m_methods) {
+        out.push_back(MethodMetrics{
+            method,
+            e.calls,
+            e.errors,
+            e.requestBytes,
+            e.responseBytes,
+            e.latency.percentile(0.50),
+            e.latency.percentile(0.95),
+            e.latency.percentile(0.99),
+            e.decodeTime,
+        });
+    }
+    return out;
+}
+
+std::string formatMetrics(const std::vector<MethodMetrics>& metrics) {
+    using ms = std::chrono::duration<double, std::milli>;
+    std::string out = fmt::format("{:<24} {:>8} {:>7} {:>10} {:>10} {:>10} {:>12} {:>12} {:>12}\n", "method", "calls",
+                                  "errors", "p50 ms", "p95 ms", "p99 ms", "sent B", "received B", "decode ms");
+    for (const auto& m : metrics) {
+        out += fmt::format("{:<24} {:>8} {:>7} {:>10.2f} {:>10.2f} {:>10.2f} {:>12} {:>12} {:>12.2f}\n", m.method,
+                           m.calls, m.errors, ms(m.p50).count(), ms(m.p95).count(), ms(m.p99).count(), m.requestBytes,
+                           m.responseBytes, ms(m.decodeTime).count());
+    }
+    return out;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+//! Per-method call metrics, recorded by the client on every call.
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "client.h"
+
+/// Histogram of durations with buckets growing exponentially in size,
+/// so percentiles are accurate to within an eighth regardless of magnitude.
+class LatencyHistogram {
+   public:
+    LatencyHistogram();
+
+    void record(std::chrono::nanoseconds d);
+    /// Approximate duration below which the given fraction (0 to 1) of recorded durations fall.
+    std::chrono::nanoseconds percentile(double p) const;
+    std::uint64_t count() const;
+
+   private:
+    /// Each power of two range is split into 2^SUB_BUCKET_BITS equally sized buckets.
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    /// Enough to cover microseconds up to days.
+    static constexpr std::size_t BUCKETS = SUB_BUCKETS * 40;
+
+    static std::size_t bucketOf(std::uint64_t us);
+    static std::uint64_t upperBoundOf(std::size_t bucket);
+
+    std::array<std::uint64_t, BUCKETS> m_buckets;
+    std::uint64_t m_count;
+};
+
+/// Collects metrics for all methods called through a client.
+/// All methods are safe to call from multiple threads concurrently.
+class Metrics {
+   public:
+    /// Record a finished round trip.
+    void recordCall(const std::string& method, std::chrono::nanoseconds latency, std::size_t requestBytes,
+                    std::size_t responseBytes, bool failed);
+    /// Record time spent turning a response into the data structures handed to the caller.
+    void recordDecode(const std::string& method, std::chrono::nanoseconds duration, bool failed);
+    std::vector<MethodMetrics> snapshot() const;
+
+   private:
+    struct Entry {
+        std::uint64_t calls = 0;
+        std::uint64_t errors = 0;
+        std::uint64_t requestBytes = 0;
+        std::uint64_t responseBytes = 0;
+        LatencyHistogram latency;
+        std::chrono::nanoseconds decodeTime{0};
+    };
+
+    mutable std::mutex m_lock;
+    // Ordered, so dumps list methods in a stable order
+    std::map<std::string, Entry> m_methods;
+};
+
+/// Render metrics as a human-readable table, one method per line.
+std::string formatMetrics(const std::vector<MethodMetrics>& metrics);
@@ -0,0 +1,278 @@
+#pragma once
+
+//! Declarative descriptions of the records in server responses, and a decoder generated from them.
+//! A record type is described by specializing Schema for it, listing the key each field is sent under
+//! and how to store it. Keys are looked up through a perfect hash built at compile time,
+//! so decoding a member costs one hash and one comparison no matter how many fields a record has.
+//! Decoders work on both ValueView and StreamValue.
+
+#include <fmt/core.h>
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Specialized for every record type, with
+/// - `NAME`: what the record is called in error messages,
+/// - `STRICT`: whether unknown keys are an error rather than ignored,
+/// - `FIELDS`: a tuple of field descriptions, see field() and friends below.
+template <typename T>
+struct Schema;
+
+/// Parse a decimal or 0x-prefixed hexadecimal integer, as used for keys.
+/// Throws unless all of `s` is a number that fits into an `Int`.
+template <typename Int>
+Int parseInteger(std::string_view s) {
+    std::string_view digits = s;
+    int base = 10;
+    if (digits.size() > 2 && digits[0] == '0' && (digits[1] == 'x' || digits[1] == 'X')) {
+        digits.remove_prefix(2);
+        base = 16;
+    }
+    Int out{};
+    const auto [end, ec] = std::from_chars(digits.data(), digits.data() + digits.size(), out, base);
+    if (ec != std::errc() || end != digits.data() + digits.size()) {
+        throw std::runtime_error(fmt::format("Failed to parse response: {} is not a valid number", s));
+    }
+    return out;
+}
+
+// Declared up front so they can all find each other, whatever types they end up recursing through
+template <typename V>
+void assignValue(std::string& out, const V& v);
+template <typename Int, typename V>
+std::enable_if_t<std::is_integral_v<Int>> assignValue(Int& out, const V& v);
+template <typename E, typename V>
+void assignValue(std::vector<E>& out, const V& v);
+template <typename T, typename V>
+decltype(Schema<T>::FIELDS, void()) assignValue(T& out, const V& v);
+template <typename T, typename V>
+T decodeRecord(const V& v);
+
+template <typename V>
+void assignValue(std::string& out, const V& v) {
+    out = v.asString();
+}
+
+template <typename Int, typename V>
+std::enable_if_t<std::is_integral_v<Int>> assignValue(Int& out, const V& v) {
+    out = static_cast<Int>(v.asInt());
+}
+
+template <typename E, typename V>
+void assignValue(std::vector<E>& out, const V& v) {
+    v.forEachItem([&out](const auto& item) {
+        E e{};
+        assignValue(e, item);
+        out.push_back(std::move(e));
+    });
+}
+
+template <typename T, typename V>
+decltype(Schema<T>::FIELDS, void()) assignValue(T& out, const V& v) {
+    out = decodeRecord<T>(v);
+}
+
+inline void assignKey(std::string& out, std::string_view key) { out = std::string(key); }
+
+template <typename Int>
+std::enable_if_t<std::is_integral_v<Int>> assignKey(Int& out, std::string_view key) {
+    out = parseInteger<Int>(key);
+}
+
+/// Stores a value into a member, converted according to the member's type.
+template <typename T, typename M>
+struct MemberSetter {
+    M T::*member;
+
+    template <typename V>
+    void operator()(T& out, const V& v) const {
+        assignValue(out.*member, v);
+    }
+};
+
+/// Stores a struct of records into a vector, with each record's key in the struct stored into a member of it.
+template <typename T, typename E, typename K>
+struct KeyedSetter {
+    std::vector<E> T::*member;
+    K E::*keyMember;
+
+    template <typename V>
+    void operator()(T& out, const V& v) const {
+        v.forEachMember([this, &out](std::string_view key, const auto& item) {
+            E e = decodeRecord<E>(item);
+            assignKey(e.*keyMember, key);
+            (out.*member).push_back(std::move(e));
+        });
+    }
+};
+
+/// Accepts a key without storing anything.
+struct IgnoreSetter {
+    template <typename T, typename V>
+    void operator()(T&, const V&) const {}
+};
+
+template <typename Setter>
+struct Field {
+    std::string_view key;
+    bool required;
+    Setter set;
+};
+
+/// A member stored under `key`.
+template <typename T, typename M>
+constexpr Field<MemberSetter<T, M>> field(std::string_view key, M T::*member) {
+    return {key, false, MemberSetter<T, M>{member}};
+}
+
+/// Like field(), but decoding fails if the key is missing.
+template <typename T, typename M>
+constexpr Field<MemberSetter<T, M>> requiredField(std::string_view key, M T::*member) {
+    return {key, true, MemberSetter<T, M>{member}};
+}
+
+/// A struct under `key` whose members are records, keyed by one of their own fields.
+template <typename T, typename E, typename K>
+constexpr Field<KeyedSetter<T, E, K>> keyedField(std::string_view key, std::vector<E> T::*member,
+                                                 K E::*keyMember) {
+    return {key, false, KeyedSetter<T, E, K>{member, keyMember}};
+}
+
+/// A key that's known but of no interest.
+constexpr Field<IgnoreSetter> ignoredField(std::string_view key) { return {key, false, IgnoreSetter{}}; }
+
+/// A key handled by `setter`, which is called with the record and the value.
+template <typename Setter>
+constexpr Field<Setter> customField(std::string_view key, Setter setter) {
+    return {key, false, setter};
+}
+
+constexpr std::uint32_t keyHash(std::string_view key, std::uint32_t seed) {
+    // FNV-1a
+    std::uint32_t h = 2166136261u ^ seed;
+    for (const char c : key) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    // FNV's low bits only depend on the low bits of its input, mix the high ones in
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    return h;
+}
+
+/// Maps each of `N` keys to its index without collisions.
+template <std::size_t N>
+struct KeyTable {
+    /// At least twice as many slots as keys, so a collision-free seed is found quickly.
+    static constexpr std::size_t SLOTS = [] {
+        std::size_t n = 1;
+        while (n < 2 * N) {
+            n *= 2;
+        }
+        return n;
+    }();
+    static constexpr std::uint8_t EMPTY = 0xFF;
+    static_assert(N < EMPTY, "Too many keys");
+
+    std::uint32_t seed;
+    std::array<std::string_view, N> keys;
+    std::array<std::uint8_t, SLOTS> slots;
+
+    /// Index of `key`, -1 if it isn't one of the keys.
+    constexpr int find(std::string_view key) const {
+        const std::uint8_t i = slots[keyHash(key, seed) & (SLOTS - 1)];
+        return i != EMPTY && keys[i] == key ? i : -1;
+    }
+};
+
+template <std::size_t N>
+constexpr KeyTable<N> makeKeyTable(const std::array<std::string_view, N>& keys) {
+    for (std::uint32_t seed = 0; seed < 100000; seed++) {
+        KeyTable<N> table{seed, keys, {}};
+        for (auto& slot : table.slots) {
+            slot = KeyTable<N>::EMPTY;
+        }
+        bool collision = false;
+        for (std::size_t i = 0; i < N && !collision; i++) {
+            auto& slot = table.slots[keyHash(keys[i], seed) & (KeyTable<N>::SLOTS - 1)];
+            collision = slot != KeyTable<N>::EMPTY;
+            slot = static_cast<std::uint8_t>(i);
+        }
+        if (!collision) {
+            return table;
+        }
+    }
+    // Not a constant expression, so this fails the build
+    throw std::logic_error("No perfect hash for schema keys, are some of them duplicates?");
+}
+
+template <typename T, typename V, std::size_t... Is>
+constexpr auto makeSetters(std::index_sequence<Is...>) {
+    return std::array<void (*)(T&, const V&), sizeof...(Is)>{
+        [](T& out, const V& v) { std::get<Is>(Schema<T>::FIELDS).set(out, v); }...};
+}
+
+/// Everything needed for decoding `T` from values of type `V`, built at compile time.
+template <typename T, typename V>
+struct RecordTables {
+    using S = Schema<T>;
+    static constexpr std::size_t N = std::tuple_size_v<std::decay_t<decltype(S::FIELDS)>>;
+    static_assert(N <= 64, "Too many fields to track which ones were seen");
+
+    static constexpr auto KEYS = makeKeyTable(
+        std::apply([](const auto&... f) { return std::array<std::string_view, N>{f.key...}; }, S::FIELDS));
+    static constexpr auto SETTERS = makeSetters<T, V>(std::make_index_sequence<N>());
+    /// Bit i is set if field i is required.
+    static constexpr std::uint64_t REQUIRED = std::apply(
+        [](const auto&... f) {
+            std::uint64_t mask = 0;
+            std::size_t i = 0;
+            ((mask |= std::uint64_t(f.required) << i++), ...);
+            return mask;
+        },
+        S::FIELDS);
+};
+
+/// Decode a record described by `Schema<T>` from a struct value.
+template <typename T, typename V>
+T decodeRecord(const V& v) {
+    using S = Schema<T>;
+    using Tables = RecordTables<T, V>;
+
+    T out{};
+    std::uint64_t seen = 0;
+    v.forEachMember([&out, &seen](std::string_view key, const auto& value) {
+        const int i = Tables::KEYS.find(key);
+        if (i < 0) {
+            if constexpr (S::STRICT) {
+                throw std::runtime_error(fmt::format("Encountered unknown {} field: {}", S::NAME, key));
+            }
+            return;
+        }
+        Tables::SETTERS[i](out, value);
+        seen |= std::uint64_t(1) << i;
+    });
+
+    if ((seen & Tables::REQUIRED) != Tables::REQUIRED) {
+        std::string missing{};
+        for (std::size_t i = 0; i < Tables::N; i++) {
+            if ((Tables::REQUIRED & ~seen) & (std::uint64_t(1) << i)) {
+                missing += missing.empty() ? "" : ", ";
+                missing += Tables::KEYS.keys[i];
+            }
+        }
+        throw std::runtime_error(fmt::format("Missing required {} fields: {}", S::NAME, missing));
+    }
+    return out;
+}
@@ -0,0 +1,112 @@
+//! Serves the stand-in server's methods over a shared memory channel, for SharedMemoryTransport.
+//! Stands in for a decompiler on the same machine that talks over shared memory instead of HTTP.
+
+#include <fmt/core.h>
+// Keep windows.h from clobbering std::min and std::max
+#define NOMINMAX
+#include <windows.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <xmlrpc-c/registry.hpp>
+
+#include "shm_ring.h"
+#include "stand_in.h"
+
+/// Read exactly `len` bytes off `ring`, appending them to `out`.
+static void receive(ByteRing& ring, std::size_t len, std::string& out, HANDLE dataEvent, HANDLE spaceEvent) {
+    while (len > 0) {
+        const std::size_t n = ring.readSome(len, [&out](const char* data, std::size_t n) { out.append(data, n); });
+        if (n == 0) {
+            WaitForSingleObject(dataEvent, INFINITE);
+            continue;
+        }
+        SetEvent(spaceEvent);
+        len -= n;
+    }
+}
+
+/// Write all of `data` to `ring`.
+static void send(ByteRing& ring, const char* data, std::size_t len, HANDLE dataEvent, HANDLE spaceEvent) {
+    while (len > 0) {
+        const std::size_t n = ring.writeSome(data, len);
+        if (n == 0) {
+            WaitForSingleObject(spaceEvent, INFINITE);
+            continue;
+        }
+        SetEvent(dataEvent);
+        data += n;
+        len -= n;
+    }
+}
+
+static HANDLE createEvent(const std::string& name, const char* what) {
+    HANDLE event = CreateEventA(nullptr, FALSE, FALSE, shmEventName(name, what).c_str());
+    if (!event) {
+        fmt::print("Failed to create {} event: error {}\n", what, GetLastError());
+        std::exit(1);
+    }
+    return event;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 3) {
+        fmt::print("Usage: {} [channel name] [symbol count]\n", argv[0]);
+        return 1;
+    }
+    const std::string name = argc > 1 ? argv[1] : "decomp2dbg";
+    const int symbols = argc > 2 ? std::atoi(argv[2]) : 1000;
+
+    xmlrpc_c::registry reg;
+    registerStandInMethods(reg, symbols);
+
+    HANDLE requestData = createEvent(name, "request-data");
+    HANDLE requestSpace = createEvent(name, "request-space");
+    HANDLE responseData = createEvent(name, "response-data");
+    HANDLE responseSpace = createEvent(name, "response-space");
+
+    const std::uint64_t size = shmMappingSize(SHM_RING_CAPACITY);
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+                                        static_cast<DWORD>(size), shmMappingName(name).c_str());
+    if (!mapping || GetLastError() == ERROR_ALREADY_EXISTS) {
+        fmt::print("Failed to create shared memory channel {}, is another bridge serving it?\n", name);
+        return 1;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!view) {
+        fmt::print("Failed to map shared memory channel: error {}\n", GetLastError());
+        return 1;
+    }
+    // The mapping starts out zeroed, so both rings start out empty
+    auto* header = new (view) ShmHeader{};
+    header->capacity = SHM_RING_CAPACITY;
+    header->serverPid = GetCurrentProcessId();
+    char* rings = static_cast<char*>(view) + sizeof(ShmHeader);
+    ByteRing requests(header->requests, rings, SHM_RING_CAPACITY);
+    ByteRing responses(header->responses, rings + SHM_RING_CAPACITY, SHM_RING_CAPACITY);
+    // Last, clients don't touch anything before they see this
+    header->magic = SHM_MAGIC;
+
+    fmt::print("Stand-in bridge serving shared memory channel {} with {} symbols\n", name, symbols);
+    std::string frameHeader;
+    std::string request;
+    std::string response;
+    for (;;) {
+        frameHeader.clear();
+        receive(requests, SHM_FRAME_HEADER_SIZE, frameHeader, requestData, requestSpace);
+        request.clear();
+        receive(requests, decodeFrameLength(frameHeader.data()), request, requestData, requestSpace);
+
+        response.clear();
+        reg.processCall(request, &response);
+
+        std::array<char, SHM_FRAME_HEADER_SIZE> responseHeader{};
+        encodeFrameLength(static_cast<std::uint32_t>(response.size()), responseHeader.data());
+        send(responses, responseHeader.data(), responseHeader.size(), responseData, responseSpace);
+        send(responses, response.data(), response.size(), responseData, responseSpace);
+    }
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+//! Layout of the shared memory SharedMemoryTransport and clientShmBridge exchange calls through.
+//! A header with the positions of two byte rings, followed by the rings themselves:
+//! one carrying requests from the client to the bridge, one carrying responses back.
+//! Every message on either ring is a little-endian u32 length followed by that many bytes.
+//! Only fixed-size types are used, so 32 and 64-bit processes can share a channel.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+constexpr std::array<char, 8> SHM_MAGIC = {'D', '2', 'D', 'S', 'H', 'M', '0', '1'};
+/// Bytes buffered per direction, large enough to hold all function headers of a big binary at once.
+constexpr std::uint32_t SHM_RING_CAPACITY = 1 << 24;
+/// Size of the length prefix of every message.
+constexpr std::size_t SHM_FRAME_HEADER_SIZE = 4;
+
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "Ring positions are shared between processes");
+
+/// Kept apart from everything else, so producer and consumer don't fight over the same cache line.
+struct alignas(64) RingIndex {
+    std::atomic<std::uint32_t> pos;
+};
+
+/// Positions only ever grow, wrapping around at 2^32. The offset into the ring is a position modulo its capacity.
+struct RingState {
+    /// Only written by the producer: everything before this has been written.
+    RingIndex head;
+    /// Only written by the consumer: everything before this has been read.
+    RingIndex tail;
+};
+
+struct ShmHeader {
+    std::array<char, 8> magic;
+    /// Bytes per ring, a power of two.
+    std::uint32_t capacity;
+    /// Process serving the channel, so clients notice when it's gone.
+    std::uint32_t serverPid;
+    RingState requests;
+    RingState responses;
+};
+
+/// Bytes to map for a channel with rings of `capacity` bytes.
+inline std::size_t shmMappingSize(std::uint32_t capacity) { return sizeof(ShmHeader) + 2 * std::size_t(capacity); }
+
+/// Name of the file mapping backing the channel called `name`.
+inline std::string shmMappingName(const std::string& name) { return "Local\\d2d-" + name; }
+
+/// Name of one of the events the two sides of channel `name` wake each other with.
+inline std::string shmEventName(const std::string& name, const char* what) { return shmMappingName(name) + "-" + what; }
+
+inline void encodeFrameLength(std::uint32_t len, char* out) {
+    for (std::size_t i = 0; i < SHM_FRAME_HEADER_SIZE; i++) {
+        out[i] = static_cast<char>((len >> (8 * i)) & 0xFF);
+    }
+}
+
+inline std::uint32_t decodeFrameLength(const char* in) {
+    std::uint32_t len = 0;
+    for (std::size_t i = 0; i < SHM_FRAME_HEADER_SIZE; i++) {
+        len |= std::uint32_t(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return len;
+}
+
+/// One direction of a channel, a stream of bytes with exactly one producer and one consumer.
+/// Neither side ever blocks in here, waiting for the other side to make progress is up to the caller.
+class ByteRing {
+   public:
+    ByteRing(RingState& state, char* data, std::uint32_t capacity)
+        : m_state(state), m_data(data), m_capacity(capacity) {}
+
+    /// Copy as much of `data` in as there's room for, returns how much that was.
+    std::size_t writeSome(const char* data, std::size_t len) {
+        const std::uint32_t head = m_state.head.pos.load(std::memory_order_relaxed);
+        const std::uint32_t tail = m_state.tail.pos.load(std::memory_order_acquire);
+        const std::size_t n = std::min<std::size_t>(len, m_capacity - (head - tail));
+        const std::size_t offset = head & (m_capacity - 1);
+        const std::size_t first = std::min(n, m_capacity - offset);
+        std::memcpy(m_data + offset, data, first);
+        std::memcpy(m_data, data + first, n - first);
+        m_state.head.pos.store(head + static_cast<std::uint32_t>(n), std::memory_order_release);
+        return n;
+    }
+
+    /// Hand up to `max` buffered bytes to `fn` in place, without copying them out of the ring.
+    /// Returns how many bytes that was, possibly none. Nothing is consumed if `fn` throws.
+    template <typename Fn>
+    std::size_t readSome(std::size_t max, const Fn& fn) {
+        const std::uint32_t tail = m_state.tail.pos.load(std::memory_order_relaxed);
+        const std::uint32_t head = m_state.head.pos.load(std::memory_order_acquire);
+        const std::size_t offset = tail & (m_capacity - 1);
+        // Only up to the end of the ring, the rest is picked up by the next call
+        const std::size_t n = std::min({max, std::size_t(head - tail), m_capacity - offset});
+        if (n > 0) {
+            fn(static_cast<const char*>(m_data + offset), n);
+            m_state.tail.pos.store(tail + static_cast<std::uint32_t>(n), std::memory_order_release);
+        }
+        return n;
+    }
+
+   private:
+    RingState& m_state;
+    char* m_data;
+    std::size_t m_capacity;
+};
@@ -0,0 +1,214 @@
+#include "shm_transport.h"
+
+#include <fmt/core.h>
+// Keep windows.h from clobbering std::min and std::max
+#define NOMINMAX
+#include <windows.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+#include "shm_ring.h"
+
+/// Upper bound on how long a call waits for the bridge before checking on its deadline again.
+static constexpr DWORD MAX_WAIT_MS = 1000;
+
+struct SharedMemoryTransport::Channel {
+    HANDLE mapping = nullptr;
+    ShmHeader* header = nullptr;
+    // Set by whoever made progress on a ring, for the other side waiting on it
+    HANDLE requestData = nullptr;
+    HANDLE requestSpace = nullptr;
+    HANDLE responseData = nullptr;
+    HANDLE responseSpace = nullptr;
+    HANDLE server = nullptr;
+    // Set when a call waiting on the bridge is cancelled
+    HANDLE wake = nullptr;
+    std::optional<ByteRing> requests;
+    std::optional<ByteRing> responses;
+
+    Channel() = default;
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+    ~Channel() {
+        if (header) {
+            UnmapViewOfFile(header);
+        }
+        for (HANDLE h : {mapping, requestData, requestSpace, responseData, responseSpace, server, wake}) {
+            if (h) {
+                CloseHandle(h);
+            }
+        }
+    }
+
+    /// Block until `event` is set, or for a while at most.
+    /// Throws if the call should be abandoned or the bridge has gone away.
+    void wait(HANDLE event, const CallOptions& opts) const {
+        opts.check();
+        DWORD timeoutMs = MAX_WAIT_MS;
+        if (opts.deadline) {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(*opts.deadline - CallOptions::Clock::now());
+            timeoutMs = static_cast<DWORD>(std::clamp<long long>(left.count(), 0, MAX_WAIT_MS));
+        }
+        const HANDLE handles[] = {event, server, wake};
+        const DWORD r = WaitForMultipleObjects(3, handles, FALSE, timeoutMs);
+        if (r == WAIT_OBJECT_0 + 1) {
+            throw std::runtime_error("Shared memory bridge exited");
+        }
+        if (r == WAIT_FAILED) {
+            throw std::runtime_error(fmt::format("Failed to wait for shared memory bridge: error {}", GetLastError()));
+        }
+        opts.check();
+    }
+};
+
+static HANDLE openEvent(const std::string& name, const char* what) {
+    HANDLE event = OpenEventA(SYNCHRONIZE | EVENT_MODIFY_STATE, FALSE, shmEventName(name, what).c_str());
+    if (!event) {
+        throw std::runtime_error(
+            fmt::format("Failed to open {} event of shared memory channel {}: error {}", what, name, GetLastError()));
+    }
+    return event;
+}
+
+SharedMemoryTransport::SharedMemoryTransport(const std::string& name)
+    : m_channel(std::make_unique<Channel>()),
+      m_owed(0),
+      m_frameHeader{},
+      m_frameHeaderRead(0),
+      m_bodyLeft(0),
+      m_broken(false),
+      m_requestBytes(0),
+      m_responseBytes(0) {
+    static_assert(std::tuple_size<decltype(m_frameHeader)>::value == SHM_FRAME_HEADER_SIZE);
+
+    Channel& c = *m_channel;
+    c.mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, shmMappingName(name).c_str());
+    if (!c.mapping) {
+        throw std::runtime_error(
+            fmt::format("Nothing is serving shared memory channel {}: error {}", name, GetLastError()));
+    }
+    void* view = MapViewOfFile(c.mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!view) {
+        throw std::runtime_error(
+            fmt::format("Failed to map shared memory channel {}: error {}", name, GetLastError()));
+    }
+    c.header = static_cast<ShmHeader*>(view);
+    if (c.header->magic != SHM_MAGIC) {
+        throw std::runtime_error(fmt::format("{} is not a decomp2dbg shared memory channel", name));
+    }
+    const std::uint32_t capacity = c.header->capacity;
+    char* rings = static_cast<char*>(view) + sizeof(ShmHeader);
+    c.requests.emplace(c.header->requests, rings, capacity);
+    c.responses.emplace(c.header->responses, rings + capacity, capacity);
+
+    c.requestData = openEvent(name, "request-data");
+    c.requestSpace = openEvent(name, "request-space");
+    c.responseData = openEvent(name, "response-data");
+    c.responseSpace = openEvent(name, "response-space");
+    c.server = OpenProcess(SYNCHRONIZE, FALSE, c.header->serverPid);
+    if (!c.server) {
+        throw std::runtime_error(
+            fmt::format("Process serving shared memory channel {} is gone: error {}", name, GetLastError()));
+    }
+    c.wake = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+    if (!c.wake) {
+        throw std::runtime_error(fmt::format("Failed to create event: error {}", GetLastError()));
+    }
+}
+
+SharedMemoryTransport::~SharedMemoryTransport() = default;
+
+void SharedMemoryTransport::roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) {
+    if (request.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("Request too large for shared memory channel");
+    }
+    opts.check();
+
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    if (m_broken) {
+        throw std::runtime_error("Shared memory channel is out of sync after a request was abandoned halfway");
+    }
+    Channel& c = *m_channel;
+    const CancellationWatch watch(opts, [wake = c.wake]() { SetEvent(wake); });
+
+    // The bridge answers every request, even ones whose callers have given up on them since
+    while (m_owed > 0) {
+        readResponse([](const char*, std::size_t) {}, opts);
+    }
+
+    std::size_t sent = 0;
+    const auto send = [&](const char* data, std::size_t len) {
+        while (len > 0) {
+            const std::size_t n = c.requests->writeSome(data, len);
+            if (n == 0) {
+                c.wait(c.requestSpace, opts);
+                continue;
+            }
+            SetEvent(c.requestData);
+            data += n;
+            len -= n;
+            sent += n;
+        }
+    };
+    std::array<char, SHM_FRAME_HEADER_SIZE> frameHeader{};
+    encodeFrameLength(static_cast<std::uint32_t>(request.size()), frameHeader.data());
+    try {
+        send(frameHeader.data(), frameHeader.size());
+        send(request.data(), request.size());
+    } catch (...) {
+        m_broken = sent > 0;
+        throw;
+    }
+    m_requestBytes += request.size();
+    m_owed++;
+
+    readResponse(onData, opts);
+}
+
+void SharedMemoryTransport::readResponse(const DataSink& onData, const CallOptions& opts) {
+    Channel& c = *m_channel;
+    const auto receive = [&c, &opts](std::size_t max, const auto& fn) {
+        std::size_t n = 0;
+        while ((n = c.responses->readSome(max, fn)) == 0) {
+            c.wait(c.responseData, opts);
+        }
+        SetEvent(c.responseSpace);
+        return n;
+    };
+
+    // Picks up wherever an abandoned call left off
+    while (m_frameHeaderRead < SHM_FRAME_HEADER_SIZE) {
+        const std::size_t n =
+            receive(SHM_FRAME_HEADER_SIZE - m_frameHeaderRead, [this](const char* data, std::size_t len) {
+                std::copy(data, data + len, m_frameHeader.begin() + m_frameHeaderRead);
+            });
+        m_frameHeaderRead += n;
+        if (m_frameHeaderRead == SHM_FRAME_HEADER_SIZE) {
+            m_bodyLeft = decodeFrameLength(m_frameHeader.data());
+        }
+    }
+    while (m_bodyLeft > 0) {
+        // Big responses may well never leave the ring empty to wait on
+        opts.check();
+        const std::size_t n = receive(m_bodyLeft, onData);
+        m_bodyLeft -= static_cast<std::uint32_t>(n);
+        m_responseBytes += n;
+    }
+    m_frameHeaderRead = 0;
+    m_owed--;
+}
+
+WireStats SharedMemoryTransport::wireStats() const {
+    return WireStats{m_requestBytes, m_requestBytes, m_responseBytes, m_responseBytes};
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+//! Coalescing of identical concurrent calls.
+//! When several threads ask for the same thing at the same time, only the first actually does the work,
+//! the others wait for and share its result.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "cancellation.h"
+
+/// Runs at most one call per key at a time, handing its result to every caller that asked while it was in flight.
+/// Results aren't kept around once the call is done, so this is not a cache.
+template <typename T>
+class SingleFlight {
+   public:
+    SingleFlight() : m_calls(0), m_coalesced(0) {}
+    SingleFlight(const SingleFlight&) = delete;
+    SingleFlight& operator=(const SingleFlight&) = delete;
+
+    /// Run `fn` for `key`, or join the call already in flight for it.
+    /// Callers joining a call stop waiting as soon as their own `opts` say so.
+    /// Should the call they joined be cancelled by its own options, they retry rather than failing with it.
+    T run(const std::string& key, const CallOptions& opts, const std::function<T()>& fn) {
+        m_calls++;
+        for (;;) {
+            std::shared_ptr<Flight> flight;
+            bool leader = false;
+            {
+                const auto g = std::lock_guard<std::mutex>(m_lock);
+                auto& slot = m_inFlight[key];
+                if (!slot) {
+                    slot = std::make_shared<Flight>();
+                    leader = true;
+                }
+                flight = slot;
+            }
+
+            if (leader) {
+                lead(key, *flight, fn);
+            } else {
+                wait(*flight, opts);
+            }
+
+            const auto g = std::lock_guard<std::mutex>(flight->lock);
+            if (!leader) {
+                m_coalesced++;
+            }
+            if (flight->error) {
+                try {
+                    std::rethrow_exception(flight->error);
+                } catch (const CancelledError&) {
+                    if (leader || opts.expired()) {
+                        throw;
+                    }
+                    // Cancelled on behalf of whoever started it, not us
+                    continue;
+                }
+            }
+            return *flight->result;
+        }
+    }
+
+    /// Number of calls made, including those which joined another call.
+    std::uint64_t calls() const { return m_calls; }
+    /// Number of calls which didn't do the work themselves, but shared another call's result.
+    std::uint64_t coalesced() const { return m_coalesced; }
+
+   private:
+    struct Flight {
+        std::mutex lock;
+        std::condition_variable cv;
+        bool done = false;
+        std::optional<T> result;
+        std::exception_ptr error;
+    };
+
+    void lead(const std::string& key, Flight& flight, const std::function<T()>& fn) {
+        std::optional<T> result;
+        std::exception_ptr error;
+        try {
+            result.emplace(fn());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        {
+            // Calls arriving from here on start afresh rather than joining a finished one
+            const auto g = std::lock_guard<std::mutex>(m_lock);
+            m_inFlight.erase(key);
+        }
+        const auto g = std::lock_guard<std::mutex>(flight.lock);
+        flight.result = std::move(result);
+        flight.error = error;
+        flight.done = true;
+        flight.cv.notify_all();
+    }
+
+    static void wait(Flight& flight, const CallOptions& opts) {
+        const CancellationWatch watch(opts, [&flight]() {
+            const auto g = std::lock_guard<std::mutex>(flight.lock);
+            flight.cv.notify_all();
+        });
+        auto l = std::unique_lock<std::mutex>(flight.lock);
+        const auto ready = [&]() { return flight.done || opts.expired(); };
+        if (opts.deadline) {
+            flight.cv.wait_until(l, *opts.deadline, ready);
+        } else {
+            flight.cv.wait(l, ready);
+        }
+        if (!flight.done) {
+            l.unlock();
+            opts.check();
+        }
+    }
+
+    std::mutex m_lock;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> m_inFlight;
+    std::atomic<std::uint64_t> m_calls;
+    std::atomic<std::uint64_t> m_coalesced;
+};
@@ -0,0 +1,141 @@
+#include "stand_in.h"
+
+#include <fmt/core.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <xmlrpc-c/base.hpp>
+#include <xmlrpc-c/registry.hpp>
+
+/// Size of every synthetic function in bytes.
+static constexpr int FUNC_SIZE = 0x100;
+/// Number of source lines in every synthetic function.
+static constexpr int FUNC_LINES = 64;
+
+class PingMethod : public xmlrpc_c::method {
+   public:
+    void execute(const xmlrpc_c::paramList& params, xmlrpc_c::value* retval) override {
+        params.verifyEnd(0);
+        *retval = xmlrpc_c::value_boolean(true);
+    }
+};
+
+/// Synthetic decompilation of the function containing `addr`.
+static xmlrpc_c::value decompileAt(int addr) {
+    const int func = addr / FUNC_SIZE;
+    std::vector<xmlrpc_c::value> lines;
+    for (int i = 0; i < FUNC_LINES; i++) {
+        lines.push_back(xmlrpc_c::value_string(fmt::format("    local_{:x} = FUN_{:08x}(param_1, {});", i, func, i)));
+    }
+    std::map<std::string, xmlrpc_c::value> out{
+        {"func_name", xmlrpc_c::value_string(fmt::format("FUN_{:08x}", func * FUNC_SIZE))},
+        {"decompilation", xmlrpc_c::value_array(lines)},
+        // Spread the function's bytes evenly over its lines
+        {"curr_line", xmlrpc_c::value_int((addr % FUNC_SIZE) * FUNC_LINES / FUNC_SIZE)},
+    };
+    return xmlrpc_c::value_struct(out);
+}
+
+class DecompileMethod : public xmlrpc_c::method {
+   public:
+    explicit DecompileMethod(std::chrono::milliseconds delay) : m_delay(delay) {}
+
+    void execute(const xmlrpc_c::paramList& params, xmlrpc_c::value* retval) override {
+        std::this_thread::sleep_for(m_delay);
+        *retval = decompileAt(params.getInt(0));
+    }
+
+   private:
+    std::chrono::milliseconds m_delay;
+};
+
+/// Answers like system.multicall would, with every result wrapped in a single-element array.
+class DecompileManyMethod : public xmlrpc_c::method {
+   public:
+    explicit DecompileManyMethod(std::chrono::milliseconds delay) : m_delay(delay) {}
+
+    void execute(const xmlrpc_c::paramList& params, xmlrpc_c::value* retval) override {
+        const std::vector<xmlrpc_c::value> addrs = xmlrpc_c::value_array(params[0]).vectorValueValue();
+        std::vector<xmlrpc_c::value> results;
+        results.reserve(addrs.size());
+        for (const auto& addr : addrs) {
+            std::this_thread::sleep_for(m_delay);
+            const std::vector<xmlrpc_c::value> result{decompileAt(xmlrpc_c::value_int(addr))};
+            results.push_back(xmlrpc_c::value_array(result));
+        }
+        *retval = xmlrpc_c::value_array(results);
+    }
+
+   private:
+    std::chrono::milliseconds m_delay;
+};
+
+class CapabilitiesMethod : public xmlrpc_c::method {
+   public:
+    explicit CapabilitiesMethod(bool compressedRequests) : m_compressedRequests(compressedRequests) {}
+
+    void execute(const xmlrpc_c::paramList& params, xmlrpc_c::value* retval) override {
+        // The client announces the protocol revision it speaks, the stand-in only knows one
+        params.getInt(0);
+        std::vector<xmlrpc_c::value> features{xmlrpc_c::value_string("multicall"),
+                                              xmlrpc_c::value_string("decompile_many"),
+                                              xmlrpc_c::value_string("revision")};
+        if (m_compressedRequests) {
+            features.push_back(xmlrpc_c::value_string("compressed_requests"));
+        }
+        std::map<std::string, xmlrpc_c::value> out{
+            {"version", xmlrpc_c::value_string("stand-in")},
+            {"protocol", xmlrpc_c::value_int(1)},
+            {"features", xmlrpc_c::value_array(features)},
+        };
+        *retval = xmlrpc_c::value_struct(out);
+    }
+
+   private:
+    bool m_compressedRequests;
+};
+
+class RevisionMethod : public xmlrpc_c::method {
+   public:
+    void execute(const xmlrpc_c::paramList& params, xmlrpc_c::value* retval) override {
+        params.verifyEnd(0);
+        // Synthetic data never changes
+        *retval = xmlrpc_c::value_int(1);
+    }
+};
+
+class SymbolsMethod : public xmlrpc_c::method {
+   public:
+    SymbolsMethod(int count, const char* prefix) : m_count(count), m_prefix(prefix) {}
+
+    void execute(const xmlrpc_c::paramList& params, xmlrpc_c::value* retval) override {
+        params.verifyEnd(0);
+        std::map<std::string, xmlrpc_c::value> out{};
+        for (int i = 0; i < m_count; i++) {
+            std::map<std::string, xmlrpc_c::value> sym{
+                {"name", xmlrpc_c::value_string(fmt::format("{}_{:08x}", m_prefix, i * FUNC_SIZE))},
+                {"size", xmlrpc_c::value_int(FUNC_SIZE)},
+            };
+            out.emplace(fmt::format("0x{:x}", i * FUNC_SIZE), xmlrpc_c::value_struct(sym));
+        }
+        *retval = xmlrpc_c::value_struct(out);
+    }
+
+   private:
+    int m_count;
+    const char* m_prefix;
+};
+
+void registerStandInMethods(xmlrpc_c::registry& reg, int symbols, std::chrono::milliseconds decompileDelay,
+                            bool compressedRequests) {
+    reg.addMethod("d2d.ping", xmlrpc_c::methodPtr(new PingMethod));
+    reg.addMethod("d2d.decompile", xmlrpc_c::methodPtr(new DecompileMethod(decompileDelay)));
+    reg.addMethod("d2d.decompile_many", xmlrpc_c::methodPtr(new DecompileManyMethod(decompileDelay)));
+    reg.addMethod("d2d.capabilities", xmlrpc_c::methodPtr(new CapabilitiesMethod(compressedRequests)));
+    reg.addMethod("d2d.revision", xmlrpc_c::methodPtr(new RevisionMethod));
+    reg.addMethod("d2d.function_headers", xmlrpc_c::methodPtr(new SymbolsMethod(symbols, "FUN")));
+    reg.addMethod("d2d.global_vars", xmlrpc_c::methodPtr(new SymbolsMethod(symbols, "DAT")));
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+//! Synthetic implementations of the decomp2dbg server methods,
+//! shared by the stand-in server and in-process benchmarks.
+
+#include <chrono>
+#include <xmlrpc-c/registry.hpp>
+
+/// Register d2d.ping, d2d.capabilities, d2d.revision, d2d.decompile, d2d.decompile_many,
+/// d2d.function_headers and d2d.global_vars, the latter two serving `symbols` entries each.
+/// Every decompilation takes at least `decompileDelay`, to mimic a real decompiler's think time.
+/// d2d.capabilities only advertises compressed_requests if `compressedRequests` is set, for servers taking them.
+void registerStandInMethods(xmlrpc_c::registry& reg, int symbols,
+                            std::chrono::milliseconds decompileDelay = std::chrono::milliseconds(0),
+                            bool compressedRequests = false);
@@ -0,0 +1,33 @@
+//! Stand-in for a decomp2dbg decompiler server, serving synthetic data.
+//! Useful for benchmarking the client without having to run a real decompiler.
+
+#include <fmt/core.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <xmlrpc-c/registry.hpp>
+#include <xmlrpc-c/server_abyss.hpp>
+
+#include "stand_in.h"
+
+int main(int argc, char** argv) {
+    if (argc > 4) {
+        fmt::print("Usage: {} [port] [symbol count] [decompile delay ms]\n", argv[0]);
+        return 1;
+    }
+    const unsigned int port = argc > 1 ? std::atoi(argv[1]) : 3662;
+    const int symbols = argc > 2 ? std::atoi(argv[2]) : 1000;
+    const auto delay = std::chrono::milliseconds(argc > 3 ? std::atoi(argv[3]) : 0);
+
+    xmlrpc_c::registry reg;
+    registerStandInMethods(reg, symbols, delay);
+
+    xmlrpc_c::serverAbyss server(xmlrpc_c::serverAbyss::constrOpt()
+                                     .registryP(&reg)
+                                     .portNumber(port)
+                                     // Allow clients to keep their connection open
+                                     .keepaliveTimeout(30)
+                                     .keepaliveMaxConn(1000000));
+    fmt::print("Stand-in server listening on port {} with {} symbols\n", port, symbols);
+    server.run();
+}
@@ -0,0 +1,275 @@
+#include "stream_decoder.h"
+
+#include <fmt/core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "client.h"
+
+const std::string& StreamValue::asString() const {
+    if (kind != Kind::String) {
+        throw std::runtime_error("Expected a string value");
+    }
+    return text;
+}
+
+std::int64_t StreamValue::asInt() const {
+    if (kind != Kind::Int) {
+        throw std::runtime_error("Expected an integer value");
+    }
+    return num;
+}
+
+/// Append the given XML text to out, resolving entity and character references.
+static void appendUnescaped(std::string& out, const char* data, std::size_t len) {
+    for (std::size_t i = 0; i < len; i++) {
+        if (data[i] != '&') {
+            out.push_back(data[i]);
+            continue;
+        }
+        std::size_t end = i + 1;
+        while (end < len && data[end] != ';') {
+            end++;
+        }
+        if (end == len) {
+            throw std::runtime_error("Unterminated entity reference");
+        }
+        const std::string entity(data + i + 1, end - i - 1);
+        if (entity == "lt") {
+            out.push_back('<');
+        } else if (entity == "gt") {
+            out.push_back('>');
+        } else if (entity == "amp") {
+            out.push_back('&');
+        } else if (entity == "quot") {
+            out.push_back('"');
+        } else if (entity == "apos") {
+            out.push_back('\'');
+        } else if (entity.size() > 1 && entity[0] == '#') {
+            const bool hex = entity[1] == 'x';
+            unsigned long cp = std::strtoul(entity.c_str() + (hex ? 2 : 1), nullptr, hex ? 16 : 10);
+            // Encode as UTF-8
+            if (cp < 0x80) {
+                out.push_back(static_cast<char>(cp));
+            } else if (cp < 0x800) {
+                out.push_back(static_cast<char>(0xC0 | (cp >> 6)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else if (cp < 0x10000) {
+                out.push_back(static_cast<char>(0xE0 | (cp >> 12)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            } else {
+                out.push_back(static_cast<char>(0xF0 | (cp >> 18)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 12) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back(static_cast<char>(0x80 | (cp & 0x3F)));
+            }
+        } else {
+            throw std::runtime_error(fmt::format("Unknown entity reference: {}", entity));
+        }
+        i = end;
+    }
+}
+
+static bool isScalarTag(const std::string& tag) {
+    return tag == "int" || tag == "i4" || tag == "i8" || tag == "ex:i8" || tag == "boolean" || tag == "string" ||
+           tag == "double" || tag == "dateTime.iso8601" || tag == "base64" || tag == "nil" || tag == "ex:nil";
+}
+
+StreamDecoder::StreamDecoder(std::vector<std::string> path, Sink sink)
+    : m_path(std::move(path)), m_sink(std::move(sink)), m_inName(false), m_inFault(false), m_done(false) {}
+
+void StreamDecoder::feed(const char* data, std::size_t len) {
+    m_buf.append(data, len);
+
+    std::size_t pos = 0;
+    while (pos < m_buf.size()) {
+        const std::size_t lt = m_buf.find('<', pos);
+        if (lt == std::string::npos) {
+            // Text may continue in the next chunk
+            break;
+        }
+        if (lt > pos) {
+            text(m_buf.data() + pos, lt - pos);
+            pos = lt;
+        }
+
+        if (m_buf[lt + 1] == '!' && m_buf.size() < lt + 9) {
+            // Can't tell a CDATA section from a comment yet
+            break;
+        }
+        if (m_buf.compare(lt, 9, "<![CDATA[") == 0) {
+            const std::size_t end = m_buf.find("]]>", lt + 9);
+            if (end == std::string::npos) {
+                break;
+            }
+            if (m_inName || !m_scalarTag.empty() || (!m_values.empty() && !m_values.back().typed)) {
+                m_text.append(m_buf, lt + 9, end - lt - 9);
+            }
+            pos = end + 3;
+            continue;
+        }
+
+        const std::size_t gt = m_buf.find('>', lt);
+        if (gt == std::string::npos) {
+            break;
+        }
+        pos = gt + 1;
+
+        // Declarations, processing instructions and comments carry nothing of interest
+        if (m_buf[lt + 1] == '?' || m_buf[lt + 1] == '!') {
+            continue;
+        }
+        const bool closing = m_buf[lt + 1] == '/';
+        const bool selfClosing = m_buf[gt - 1] == '/';
+        const std::size_t nameStart = lt + (closing ? 2 : 1);
+        std::size_t nameEnd = nameStart;
+        while (nameEnd < gt && m_buf[nameEnd] != '/' && m_buf[nameEnd] != ' ' && m_buf[nameEnd] != '\t' &&
+               m_buf[nameEnd] != '\r' && m_buf[nameEnd] != '\n') {
+            nameEnd++;
+        }
+        const std::string tag = m_buf.substr(nameStart, nameEnd - nameStart);
+        if (closing) {
+            closeTag(tag);
+        } else {
+            openTag(tag);
+            if (selfClosing) {
+                closeTag(tag);
+            }
+        }
+    }
+    m_buf.erase(0, pos);
+}
+
+void StreamDecoder::finish() {
+    if (!m_done) {
+        throw std::runtime_error("Response ended prematurely");
+    }
+    if (m_inFault) {
+        int code = 0;
+        std::string description = "";
+        for (const auto& [key, value] : m_result.members) {
+            if (key == "faultCode") {
+                code = static_cast<int>(value.asInt());
+            } else if (key == "faultString") {
+                description = value.asString();
+            }
+        }
+        throw FaultError(code, description);
+    }
+}
+
+void StreamDecoder::openTag(const std::string& tag) {
+    if (tag == "value") {
+        Frame f{};
+        f.typed = false;
+        if (m_values.empty()) {
+            f.matched = m_inFault ? -1 : 0;
+        } else {
+            const Frame& parent = m_values.back();
+            if (parent.value.kind == StreamValue::Kind::Struct) {
+                f.key = parent.pendingKey;
+            }
+            const bool onPath = parent.matched >= 0 && static_cast<std::size_t>(parent.matched) < m_path.size() &&
+                                parent.value.kind == StreamValue::Kind::Struct &&
+                                f.key == m_path[parent.matched];
+            f.matched = onPath ? parent.matched + 1 : -1;
+        }
+        m_values.push_back(std::move(f));
+        m_text.clear();
+    } else if (tag == "struct" || tag == "array") {
+        if (m_values.empty()) {
+            throw std::runtime_error(fmt::format("Unexpected element outside of value: {}", tag));
+        }
+        m_values.back().value.kind = tag == "struct" ? StreamValue::Kind::Struct : StreamValue::Kind::Array;
+        m_values.back().typed = true;
+    } else if (tag == "name") {
+        m_inName = true;
+        m_text.clear();
+    } else if (isScalarTag(tag)) {
+        if (m_values.empty()) {
+            throw std::runtime_error(fmt::format("Unexpected element outside of value: {}", tag));
+        }
+        m_values.back().typed = true;
+        m_scalarTag = tag;
+        m_text.clear();
+    } else if (tag == "fault") {
+        m_inFault = true;
+    } else if (tag == "methodResponse" || tag == "params" || tag == "param" || tag == "member" || tag == "data") {
+        // Structural only
+    } else {
+        throw std::runtime_error(fmt::format("Unknown element: {}", tag));
+    }
+}
+
+void StreamDecoder::closeTag(const std::string& tag) {
+    if (tag == "value") {
+        closeValue();
+    } else if (tag == "name") {
+        if (m_values.empty()) {
+            throw std::runtime_error("Member name outside of struct");
+        }
+        m_values.back().pendingKey = std::move(m_text);
+        m_text.clear();
+        m_inName = false;
+    } else if (isScalarTag(tag)) {
+        StreamValue& v = m_values.back().value;
+        if (tag == "int" || tag == "i4" || tag == "i8" || tag == "ex:i8") {
+            v.kind = StreamValue::Kind::Int;
+            v.num = std::stoll(m_text);
+        } else if (tag == "boolean") {
+            v.kind = StreamValue::Kind::Bool;
+            v.num = std::stoll(m_text);
+        } else if (tag == "double") {
+            v.kind = StreamValue::Kind::Double;
+            v.real = std::stod(m_text);
+        } else if (tag == "nil" || tag == "ex:nil") {
+            v.kind = StreamValue::Kind::Nil;
+        } else {
+            v.kind = StreamValue::Kind::String;
+            v.text = std::move(m_text);
+        }
+        m_text.clear();
+        m_scalarTag.clear();
+    } else if (tag == "methodResponse") {
+        m_done = true;
+    }
+}
+
+void StreamDecoder::text(const char* data, std::size_t len) {
+    if (m_inName || !m_scalarTag.empty() || (!m_values.empty() && !m_values.back().typed)) {
+        appendUnescaped(m_text, data, len);
+    }
+}
+
+void StreamDecoder::closeValue() {
+    if (m_values.empty()) {
+        throw std::runtime_error("Unbalanced value element");
+    }
+    Frame f = std::move(m_values.back());
+    m_values.pop_back();
+    if (!f.typed) {
+        f.value.kind = StreamValue::Kind::String;
+        f.value.text = std::move(m_text);
+        m_text.clear();
+    }
+
+    if (m_values.empty()) {
+        m_result = std::move(f.value);
+        return;
+    }
+    Frame& parent = m_values.back();
+    if (parent.matched >= 0 && static_cast<std::size_t>(parent.matched) == m_path.size()) {
+        m_sink(f.key, f.value);
+    } else if (parent.value.kind == StreamValue::Kind::Struct) {
+        parent.value.members.emplace_back(std::move(f.key), std::move(f.value));
+    } else {
+        parent.value.items.push_back(std::move(f.value));
+    }
+}
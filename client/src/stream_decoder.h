@@ -0,0 +1,94 @@
+#pragma once
+
+//! Incremental decoder for XML-RPC responses too big to comfortably hold in memory at once.
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// A decoded XML-RPC value.
+/// Only ever holds a small piece of a streamed response at a time.
+struct StreamValue {
+    enum class Kind { Nil, Int, Bool, Double, String, Array, Struct };
+
+    Kind kind = Kind::Nil;
+    std::int64_t num = 0;
+    double real = 0;
+    /// Contents of strings, and the raw text of base64 and dateTime values.
+    std::string text;
+    std::vector<StreamValue> items;
+    std::vector<std::pair<std::string, StreamValue>> members;
+
+    const std::string& asString() const;
+    std::int64_t asInt() const;
+
+    /// Same interface as ValueView, so decoders can handle either.
+    template <typename F>
+    void forEachMember(F&& fn) const {
+        for (const auto& [key, member] : members) {
+            fn(std::string_view(key), member);
+        }
+    }
+    template <typename F>
+    void forEachItem(F&& fn) const {
+        for (const auto& item : items) {
+            fn(item);
+        }
+    }
+};
+
+/// Parses an XML-RPC response that is fed to it in arbitrarily sized chunks.
+/// Every element of the container at `path` (the struct member names leading there from the result)
+/// is handed to the sink as soon as it is complete and then dropped. This bounds memory use by the
+/// size of the largest element, rather than the size of the whole response.
+/// The sink receives the member name under which the element sits, or "" for array elements.
+class StreamDecoder {
+   public:
+    using Sink = std::function<void(const std::string& key, const StreamValue& value)>;
+
+    StreamDecoder() = delete;
+    StreamDecoder(std::vector<std::string> path, Sink sink);
+
+    void feed(const char* data, std::size_t len);
+    /// Check that the response is complete.
+    /// Throws FaultError if the server responded with a fault.
+    void finish();
+
+   private:
+    /// A <value> element under construction.
+    struct Frame {
+        StreamValue value;
+        /// Member name under which this value sits in its parent.
+        std::string key;
+        /// Name of the member currently being read, for structs.
+        std::string pendingKey;
+        /// Number of path steps leading to this value, -1 if it's not on the path.
+        int matched;
+        /// Whether a type element was seen, otherwise the value is an untyped string.
+        bool typed;
+    };
+
+    void openTag(const std::string& tag);
+    void closeTag(const std::string& tag);
+    void text(const char* data, std::size_t len);
+    void closeValue();
+
+    std::vector<std::string> m_path;
+    Sink m_sink;
+    /// Received data that hasn't been tokenized yet.
+    std::string m_buf;
+    std::vector<Frame> m_values;
+    /// Text of the current scalar or member name.
+    std::string m_text;
+    /// Type element of the scalar currently being read, empty if none.
+    std::string m_scalarTag;
+    bool m_inName;
+    bool m_inFault;
+    bool m_done;
+    /// The result if it was not streamed, such as a fault.
+    StreamValue m_result;
+};
@@ -0,0 +1,114 @@
+#include "transport.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "http.h"
+#include "worker_pool.h"
+
+/// Round trips started through the default Transport::startRoundTrip() carried out at once, across all transports.
+static constexpr std::size_t ROUND_TRIP_WORKERS = 8;
+
+void Transport::startRoundTrip(std::string request, DataSink onData, CallOptions opts, Completion onDone) {
+    static WorkerPool workers(ROUND_TRIP_WORKERS);
+    workers.submit([this, request = std::move(request), onData = std::move(onData), opts = std::move(opts),
+                    onDone = std::move(onDone)]() {
+        std::exception_ptr error;
+        try {
+            roundTrip(request, onData, opts);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        onDone(error);
+    });
+}
+
+WireStats Transport::wireStats() const { return WireStats{0, 0, 0, 0}; }
+
+void Transport::compressRequests() {}
+
+bool Transport::available() const { return true; }
+
+HttpTransport::HttpTransport(const std::string& url)
+    : m_url(url),
+      m_compressRequests(false),
+      m_requestBytes(0),
+      m_requestWireBytes(0),
+      m_responseBytes(0),
+      m_responseWireBytes(0) {}
+
+HttpTransport::~HttpTransport() = default;
+
+void HttpTransport::compressRequests() { m_compressRequests = true; }
+
+WireStats HttpTransport::wireStats() const {
+    return WireStats{m_requestBytes, m_requestWireBytes, m_responseBytes, m_responseWireBytes};
+}
+
+std::unique_ptr<HttpConnection> HttpTransport::acquireConnection() {
+    {
+        const auto g = std::lock_guard<std::mutex>(m_poolLock);
+        if (!m_idleConns.empty()) {
+            auto conn = std::move(m_idleConns.back());
+            m_idleConns.pop_back();
+            return conn;
+        }
+    }
+    return std::make_unique<HttpConnection>(m_url);
+}
+
+void HttpTransport::releaseConnection(std::unique_ptr<HttpConnection> conn) {
+    const auto g = std::lock_guard<std::mutex>(m_poolLock);
+    m_idleConns.push_back(std::move(conn));
+}
+
+void HttpTransport::roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) {
+    bool received = false;
+    const auto forward = [&](const char* data, std::size_t len) {
+        received = true;
+        onData(data, len);
+    };
+    auto conn = acquireConnection();
+    try {
+        conn->post(request, forward, m_compressRequests, opts);
+    } catch (const CancelledError&) {
+        throw;
+    } catch (const std::exception&) {
+        // The server may have closed an idle connection on us, retry once on a fresh one.
+        // All d2d methods are side effect free, so this is safe as long as nothing was passed on yet.
+        // If connecting failed instead, connecting once more is unlikely to fare any better.
+        if (received || !conn->reusedConnection()) {
+            throw;
+        }
+        conn = std::make_unique<HttpConnection>(m_url);
+        conn->post(request, forward, m_compressRequests, opts);
+    }
+
+    const auto& t = conn->lastTransfer();
+    m_requestBytes += t.requestBytes;
+    m_requestWireBytes += t.requestWireBytes;
+    m_responseBytes += t.responseBytes;
+    m_responseWireBytes += t.responseWireBytes;
+    releaseConnection(std::move(conn));
+}
+
+LoopbackTransport::LoopbackTransport(Handler handler)
+    : m_handler(std::move(handler)), m_requestBytes(0), m_responseBytes(0) {}
+
+void LoopbackTransport::roundTrip(const std::string& request, const DataSink& onData, const CallOptions& opts) {
+    opts.check();
+    const std::string response = m_handler(request);
+    opts.check();
+    m_requestBytes += request.size();
+    m_responseBytes += response.size();
+    onData(response.data(), response.size());
+}
+
+WireStats LoopbackTransport::wireStats() const {
+    return WireStats{m_requestBytes, m_requestBytes, m_responseBytes, m_responseBytes};
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+//! Non-owning access to decoded XML-RPC values through xmlrpc-c's C API.
+//! The C++ API copies every struct into a std::map and wraps every leaf in temporaries,
+//! walking the C value tree directly avoids all of that.
+
+#include <xmlrpc-c/base.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <xmlrpc-c/base.hpp>
+
+/// RAII wrapper around xmlrpc_env, turning faults into exceptions.
+class XmlrpcEnv {
+   public:
+    XmlrpcEnv() { xmlrpc_env_init(&m_env); }
+    XmlrpcEnv(const XmlrpcEnv&) = delete;
+    XmlrpcEnv& operator=(const XmlrpcEnv&) = delete;
+    ~XmlrpcEnv() { xmlrpc_env_clean(&m_env); }
+
+    xmlrpc_env* get() { return &m_env; }
+    void check() {
+        if (m_env.fault_occurred) {
+            std::string msg = m_env.fault_string;
+            xmlrpc_env_clean(&m_env);
+            xmlrpc_env_init(&m_env);
+            throw std::runtime_error(msg);
+        }
+    }
+
+   private:
+    xmlrpc_env m_env;
+};
+
+/// Borrowed view of a value, only valid as long as the tree it's part of.
+class ValueView {
+   public:
+    explicit ValueView(xmlrpc_value* v) : m_v(v) {}
+
+    xmlrpc_type type() const { return xmlrpc_value_type(m_v); }
+
+    /// Call `fn(key, member)` for each member of a struct.
+    /// The key is only valid for the duration of the call.
+    template <typename F>
+    void forEachMember(F&& fn) const {
+        XmlrpcEnv env;
+        const int count = xmlrpc_struct_size(env.get(), m_v);
+        env.check();
+        for (int i = 0; i < count; i++) {
+            // Both are borrowed references
+            xmlrpc_value* key;
+            xmlrpc_value* member;
+            xmlrpc_struct_get_key_and_value(env.get(), m_v, i, &key, &member);
+            env.check();
+            const char* keyStr;
+            std::size_t keyLen;
+            xmlrpc_read_string_lp(env.get(), key, &keyLen, &keyStr);
+            env.check();
+            try {
+                fn(std::string_view(keyStr, keyLen), ValueView(member));
+            } catch (...) {
+                xmlrpc_strfree(keyStr);
+                throw;
+            }
+            xmlrpc_strfree(keyStr);
+        }
+    }
+
+    /// Call `fn(item)` for each item of an array.
+    template <typename F>
+    void forEachItem(F&& fn) const {
+        XmlrpcEnv env;
+        const int count = xmlrpc_array_size(env.get(), m_v);
+        env.check();
+        for (int i = 0; i < count; i++) {
+            // Borrowed reference
+            xmlrpc_value* item = xmlrpc_array_get_item(env.get(), m_v, i);
+            env.check();
+            fn(ValueView(item));
+        }
+    }
+
+    std::string asString() const {
+        XmlrpcEnv env;
+        const char* str;
+        std::size_t len;
+        xmlrpc_read_string_lp(env.get(), m_v, &len, &str);
+        env.check();
+        std::string out(str, len);
+        xmlrpc_strfree(str);
+        return out;
+    }
+
+    std::int64_t asInt() const {
+        XmlrpcEnv env;
+        if (type() == XMLRPC_TYPE_I8) {
+            xmlrpc_int64 i;
+            xmlrpc_read_i8(env.get(), m_v, &i);
+            env.check();
+            return i;
+        }
+        int i;
+        xmlrpc_read_int(env.get(), m_v, &i);
+        env.check();
+        return i;
+    }
+
+   private:
+    xmlrpc_value* m_v;
+};
+
+/// Keeps the reference handed out by xmlrpc_c::value::cValue() for as long as views into it are needed.
+class ValueRoot {
+   public:
+    explicit ValueRoot(const xmlrpc_c::value& v) : m_v(v.cValue()) {}
+    ValueRoot(const ValueRoot&) = delete;
+    ValueRoot& operator=(const ValueRoot&) = delete;
+    ~ValueRoot() { xmlrpc_DECREF(m_v); }
+
+    ValueView view() const { return ValueView(m_v); }
+
+   private:
+    xmlrpc_value* m_v;
+};
@@ -0,0 +1,53 @@
+#include "worker_pool.h"
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+WorkerPool::WorkerPool(std::size_t workers) : m_stopping(false) {
+    if (workers == 0) {
+        throw std::invalid_argument("Worker pool needs at least one worker");
+    }
+    for (std::size_t i = 0; i < workers; i++) {
+        m_threads.emplace_back([this]() { run(); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        const auto g = std::lock_guard<std::mutex>(m_lock);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    for (auto& t : m_threads) {
+        t.join();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> job) {
+    {
+        const auto g = std::lock_guard<std::mutex>(m_lock);
+        m_jobs.push_back(std::move(job));
+    }
+    m_cv.notify_one();
+}
+
+void WorkerPool::run() {
+    while (true) {
+        std::function<void()> job;
+        {
+            auto l = std::unique_lock<std::mutex>(m_lock);
+            m_cv.wait(l, [this]() { return m_stopping || !m_jobs.empty(); });
+            // Drain the queue before exiting, so no submitted job is silently dropped
+            if (m_jobs.empty()) {
+                return;
+            }
+            job = std::move(m_jobs.front());
+            m_jobs.pop_front();
+        }
+        job();
+    }
+}
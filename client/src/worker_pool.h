@@ -0,0 +1,35 @@
+#pragma once
+
+//! Fixed-size thread pool used to run client calls in the background.
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Runs submitted jobs on a fixed number of threads.
+/// The thread count is also the upper bound on how many jobs run at once,
+/// anything beyond that waits in the queue.
+class WorkerPool {
+   public:
+    WorkerPool() = delete;
+    explicit WorkerPool(std::size_t workers);
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    /// Finishes all queued jobs, then joins the workers.
+    ~WorkerPool();
+
+    void submit(std::function<void()> job);
+
+   private:
+    void run();
+
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::deque<std::function<void()>> m_jobs;
+    bool m_stopping;
+    std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,79 @@
+#include "decompile_cache.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/// Rough size of a cached function, including what the containers holding it allocate.
+static std::size_t estimateBytes(const std::vector<InstructionLine>& lines) {
+    // List node plus index entry
+    std::size_t bytes = 128 + lines.capacity() * sizeof(InstructionLine);
+    for (const auto& line : lines) {
+        bytes += line.text.capacity();
+    }
+    return bytes;
+}
+
+DecompileCache::DecompileCache(std::size_t budgetBytes)
+    : m_budget(budgetBytes), m_bytes(0), m_hits(0), m_misses(0), m_evictions(0) {}
+
+const std::vector<InstructionLine>* DecompileCache::find(std::size_t offset) {
+    const auto it = m_index.find(offset);
+    if (it == m_index.end()) {
+        m_misses++;
+        return nullptr;
+    }
+    m_hits++;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    return &it->second->lines;
+}
+
+void DecompileCache::insert(std::size_t offset, std::vector<InstructionLine> lines) {
+    const auto it = m_index.find(offset);
+    if (it != m_index.end()) {
+        m_bytes -= it->second->bytes;
+        m_lru.erase(it->second);
+        m_index.erase(it);
+    }
+    const std::size_t bytes = estimateBytes(lines);
+    if (bytes > m_budget) {
+        return;
+    }
+    m_lru.push_front(Entry{offset, std::move(lines), bytes});
+    m_index[offset] = m_lru.begin();
+    m_bytes += bytes;
+    shrink();
+}
+
+void DecompileCache::clear() {
+    m_lru.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+void DecompileCache::setBudget(std::size_t budgetBytes) {
+    m_budget = budgetBytes;
+    shrink();
+}
+
+void DecompileCache::shrink() {
+    while (m_bytes > m_budget && !m_lru.empty()) {
+        const Entry& victim = m_lru.back();
+        m_bytes -= victim.bytes;
+        m_index.erase(victim.offset);
+        m_lru.pop_back();
+        m_evictions++;
+    }
+}
+
+std::size_t DecompileCache::budget() const { return m_budget; }
+
+std::size_t DecompileCache::bytes() const { return m_bytes; }
+
+std::size_t DecompileCache::functions() const { return m_lru.size(); }
+
+std::uint64_t DecompileCache::hits() const { return m_hits; }
+
+std::uint64_t DecompileCache::misses() const { return m_misses; }
+
+std::uint64_t DecompileCache::evictions() const { return m_evictions; }
@@ -0,0 +1,59 @@
+#pragma once
+
+//! Cache of decompiled functions, so revisiting one doesn't cost any round trips to the decompiler.
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "lines.h"
+
+/// Line maps of recently decompiled functions, keyed by their module base-relative start address,
+/// with the addresses of their instructions relative to the module base as well.
+/// Relative addresses stay valid when the module is loaded elsewhere, e.g. after restarting the debuggee.
+/// Bounded by an estimate of the memory taken up, evicting the least recently used functions first.
+/// Not thread-safe.
+class DecompileCache {
+   public:
+    DecompileCache() = delete;
+    explicit DecompileCache(std::size_t budgetBytes);
+
+    /// Line map of the function starting at `offset`, nullptr if it's not cached.
+    /// Counts as a use of the function. Only valid until the cache is next modified.
+    const std::vector<InstructionLine>* find(std::size_t offset);
+    /// Cache the line map of the function starting at `offset`, replacing anything cached for it before.
+    /// Functions too large for the budget on their own aren't cached.
+    void insert(std::size_t offset, std::vector<InstructionLine> lines);
+    void clear();
+    /// Change the budget, evicting functions right away if they no longer fit.
+    void setBudget(std::size_t budgetBytes);
+
+    std::size_t budget() const;
+    /// Estimate of the memory taken up by all cached functions.
+    std::size_t bytes() const;
+    std::size_t functions() const;
+    std::uint64_t hits() const;
+    std::uint64_t misses() const;
+    std::uint64_t evictions() const;
+
+   private:
+    struct Entry {
+        std::size_t offset;
+        std::vector<InstructionLine> lines;
+        std::size_t bytes;
+    };
+
+    /// Evict functions until everything fits into the budget.
+    void shrink();
+
+    std::size_t m_budget;
+    std::size_t m_bytes;
+    // Most recently used first
+    std::list<Entry> m_lru;
+    std::unordered_map<std::size_t, std::list<Entry>::iterator> m_index;
+    std::uint64_t m_hits;
+    std::uint64_t m_misses;
+    std::uint64_t m_evictions;
+};
@@ -0,0 +1,170 @@
+#include "decompile_queue.h"
+
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+bool DecompileQueue::Later::operator()(const Entry& a, const Entry& b) const {
+    if (a.job.priority != b.job.priority) {
+        return a.job.priority < b.job.priority;
+    }
+    return a.seq > b.seq;
+}
+
+DecompileQueue::DecompileQueue(Runner runner, FunctionOf functionOf, std::function<void()> onIdle,
+                               std::chrono::milliseconds timeout)
+    : m_run(std::move(runner)),
+      m_functionOf(std::move(functionOf)),
+      m_onIdle(std::move(onIdle)),
+      m_timeout(timeout),
+      m_seq(0),
+      m_latestIp(0),
+      m_superseded(false),
+      m_preempted(false),
+      m_stopping(false),
+      m_stats{0, 0, 0, 0, 0, 0} {
+    m_worker = std::thread([this]() { run(); });
+}
+
+DecompileQueue::~DecompileQueue() {
+    {
+        const auto g = std::lock_guard<std::mutex>(m_lock);
+        m_stopping = true;
+        m_runningToken.cancel();
+    }
+    m_wake.notify_all();
+    m_worker.join();
+}
+
+void DecompileQueue::push(std::size_t addr, DecompilePriority priority) {
+    enqueue(DecompileJob{addr, priority, std::nullopt});
+}
+
+void DecompileQueue::pushRange(std::size_t start, std::size_t end, DecompilePriority priority) {
+    enqueue(DecompileJob{start, priority, end});
+}
+
+void DecompileQueue::enqueue(const DecompileJob& job) {
+    const DecompilePriority priority = job.priority;
+    // Looked up without the lock, so the worker isn't held up by it
+    std::optional<std::size_t> function;
+    if (priority == DecompilePriority::Ip) {
+        function = m_functionOf(job.addr);
+    }
+    {
+        const auto g = std::lock_guard<std::mutex>(m_lock);
+        if (priority == DecompilePriority::Ip && m_running && !m_superseded &&
+            m_running->job.priority == DecompilePriority::Ip && function && m_running->function == function) {
+            // Still paused in the function being decompiled, its result is as good as that of the new job.
+            // Nothing at the instruction pointer queued since needs superseding either, it would have superseded
+            // the running job or been dropped the same way.
+            m_stats.queued++;
+            m_stats.covered++;
+            return;
+        }
+        const Entry entry{job, m_seq++, function};
+        if (priority == DecompilePriority::Ip) {
+            m_latestIp = entry.seq;
+        }
+        if (m_running && !m_superseded && !m_preempted) {
+            if (priority == DecompilePriority::Ip && m_running->job.priority == DecompilePriority::Ip) {
+                m_superseded = true;
+                m_runningToken.cancel();
+            } else if (priority > m_running->job.priority && m_running->job.priority == DecompilePriority::Prefetch) {
+                m_preempted = true;
+                m_runningToken.cancel();
+            }
+        }
+        m_jobs.push(entry);
+        m_stats.queued++;
+    }
+    m_wake.notify_one();
+}
+
+void DecompileQueue::clear() {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    m_jobs = decltype(m_jobs)();
+    // Not to be queued again, even if it was preempted
+    m_preempted = false;
+    m_runningToken.cancel();
+}
+
+std::size_t DecompileQueue::pending() const {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    return m_jobs.size();
+}
+
+DecompileQueueStats DecompileQueue::stats() const {
+    const auto g = std::lock_guard<std::mutex>(m_lock);
+    return m_stats;
+}
+
+void DecompileQueue::dropSuperseded() {
+    while (!m_jobs.empty() && m_jobs.top().job.priority == DecompilePriority::Ip && m_jobs.top().seq != m_latestIp) {
+        m_jobs.pop();
+        m_stats.superseded++;
+    }
+}
+
+void DecompileQueue::run() {
+    // Whether jobs ran since the queue last ran dry
+    bool ran = false;
+    while (true) {
+        Entry entry;
+        CallOptions opts;
+        {
+            auto l = std::unique_lock<std::mutex>(m_lock);
+            dropSuperseded();
+            if (m_jobs.empty() && ran && !m_stopping) {
+                ran = false;
+                l.unlock();
+                m_onIdle();
+                continue;
+            }
+            m_wake.wait(l, [this]() {
+                dropSuperseded();
+                return m_stopping || !m_jobs.empty();
+            });
+            if (m_stopping) {
+                return;
+            }
+            entry = m_jobs.top();
+            m_jobs.pop();
+            m_running = entry;
+            m_runningToken = CancellationToken();
+            m_superseded = false;
+            m_preempted = false;
+            // The deadline only starts counting once the job does
+            opts = CallOptions::within(m_timeout);
+            opts.tokens.push_back(m_runningToken);
+        }
+
+        bool cancelled = false;
+        try {
+            m_run(entry.job, opts);
+        } catch (const CancelledError&) {
+            cancelled = true;
+        } catch (const std::exception&) {
+            // The runner is meant to report its own failures, don't take the worker down with it
+        }
+        ran = true;
+
+        const auto g = std::lock_guard<std::mutex>(m_lock);
+        if (!cancelled) {
+            m_stats.completed++;
+        } else if (m_superseded) {
+            m_stats.superseded++;
+        } else if (m_preempted) {
+            m_stats.preempted++;
+            m_jobs.push(entry);
+        } else {
+            m_stats.cancelled++;
+        }
+        m_running.reset();
+    }
+}
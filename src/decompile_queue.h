@@ -0,0 +1,124 @@
+#pragma once
+
+//! Decompiling in the background, so debug event and GUI callbacks return right away
+//! instead of waiting on the decompiler.
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "cancellation.h"
+
+/// How urgently a decompilation is wanted, most urgent last.
+enum class DecompilePriority {
+    /// Code the user may look at next, e.g. callers of the current function.
+    Prefetch,
+    /// Code the user selected in the disassembly view.
+    Selection,
+    /// Code the debuggee is paused in.
+    Ip,
+    /// Not a decompilation, but fetching the debug info for the debuggee all decompilations depend on.
+    /// The job's address is unused.
+    Bootstrap,
+};
+
+struct DecompileJob {
+    std::size_t addr;
+    DecompilePriority priority;
+    /// Only set for jobs covering a range, e.g. a selection, rather than the function at `addr`: the last address in
+    /// it. The runner is to find the functions in the range and queue each of them.
+    std::optional<std::size_t> end;
+};
+
+struct DecompileQueueStats {
+    std::uint64_t queued;
+    /// Jobs at the instruction pointer dropped or cancelled because the debuggee paused elsewhere before they finished.
+    std::uint64_t superseded;
+    /// Jobs at the instruction pointer dropped as the running one is in the same function, so covers them already.
+    std::uint64_t covered;
+    /// Prefetches cancelled to make way for more urgent jobs, then queued again.
+    std::uint64_t preempted;
+    std::uint64_t completed;
+    /// Jobs cancelled for any other reason, or which ran out of time.
+    std::uint64_t cancelled;
+};
+
+/// Runs decompilations one at a time on a worker thread, most urgent first, and oldest first among equally urgent
+/// ones. Queueing a job never blocks on a running one.
+///
+/// A job at the instruction pointer supersedes all earlier jobs there, cancelling one already running, as their
+/// results would be stale by the time they're shown. Unless the running one is in the same function, then the new
+/// job is dropped instead, as it would only decompile that function again. A running prefetch is cancelled whenever
+/// anything more urgent comes in, and picked up again afterwards. Once the queue runs dry, `onIdle` is called to
+/// apply the results of all jobs run since, e.g. by refreshing the view once instead of after every job.
+class DecompileQueue {
+   public:
+    /// Decompiles a job, throwing CancelledError if `opts` asks it to stop.
+    /// Should report any other failure itself, the queue only counts it as completed.
+    using Runner = std::function<void(const DecompileJob&, const CallOptions&)>;
+    /// Start of the function containing an address, if any.
+    using FunctionOf = std::function<std::optional<std::size_t>(std::size_t addr)>;
+
+    DecompileQueue() = delete;
+    /// Every job may take up to `timeout` once started.
+    DecompileQueue(Runner runner, FunctionOf functionOf, std::function<void()> onIdle,
+                   std::chrono::milliseconds timeout);
+    DecompileQueue(const DecompileQueue&) = delete;
+    DecompileQueue& operator=(const DecompileQueue&) = delete;
+    /// Drops all queued jobs, cancels the running one and joins the worker.
+    ~DecompileQueue();
+
+    void push(std::size_t addr, DecompilePriority priority);
+    /// Queue a job covering `start` up to and including `end`, see DecompileJob::end.
+    void pushRange(std::size_t start, std::size_t end, DecompilePriority priority);
+    /// Drop all queued jobs and cancel the running one.
+    void clear();
+
+    /// Number of jobs waiting to be run, including superseded ones not yet dropped.
+    std::size_t pending() const;
+    DecompileQueueStats stats() const;
+
+   private:
+    struct Entry {
+        DecompileJob job;
+        std::uint64_t seq;
+        /// Start of the function the job is in, only looked up for jobs at the instruction pointer.
+        std::optional<std::size_t> function;
+    };
+    /// Whether `a` is to be run after `b`.
+    struct Later {
+        bool operator()(const Entry& a, const Entry& b) const;
+    };
+
+    void enqueue(const DecompileJob& job);
+    void run();
+    /// Pop superseded jobs off the top of the queue. Call with the lock held.
+    void dropSuperseded();
+
+    Runner m_run;
+    FunctionOf m_functionOf;
+    std::function<void()> m_onIdle;
+    std::chrono::milliseconds m_timeout;
+    mutable std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::priority_queue<Entry, std::vector<Entry>, Later> m_jobs;
+    std::uint64_t m_seq;
+    // Sequence number of the latest job at the instruction pointer, all earlier ones are superseded
+    std::uint64_t m_latestIp;
+    std::optional<Entry> m_running;
+    CancellationToken m_runningToken;
+    // Whether the running job was cancelled as it's superseded
+    bool m_superseded;
+    // Whether the running job was cancelled to make way for a more urgent one, and is to be queued again
+    bool m_preempted;
+    bool m_stopping;
+    DecompileQueueStats m_stats;
+    std::thread m_worker;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+//! Compact set of integers, such as addresses, stored as the disjoint ranges they form.
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <map>
+
+/// Set of values of an integer type `T`, kept as sorted, disjoint, non-adjacent half-open intervals.
+/// Adding a range merges it with whatever it overlaps or touches, so a contiguous range costs a single entry
+/// however large it is. All operations take O(log n) in the number of intervals, plus whatever they visit.
+template <typename T>
+class IntervalSet {
+   public:
+    /// Add all of [start, end).
+    void insert(T start, T end) {
+        if (start >= end) {
+            return;
+        }
+        auto it = m_intervals.upper_bound(start);
+        if (it != m_intervals.begin()) {
+            const auto prev = std::prev(it);
+            if (prev->second >= start) {
+                start = prev->first;
+                end = std::max(end, prev->second);
+                it = prev;
+            }
+        }
+        while (it != m_intervals.end() && it->first <= end) {
+            end = std::max(end, it->second);
+            it = m_intervals.erase(it);
+        }
+        m_intervals.emplace_hint(it, start, end);
+    }
+
+    /// Remove all of [start, end), splitting intervals reaching beyond it.
+    void erase(T start, T end) {
+        if (start >= end) {
+            return;
+        }
+        auto it = m_intervals.upper_bound(start);
+        if (it != m_intervals.begin() && std::prev(it)->second > start) {
+            it = std::prev(it);
+        }
+        while (it != m_intervals.end() && it->first < end) {
+            const T first = it->first;
+            const T last = it->second;
+            it = m_intervals.erase(it);
+            if (first < start) {
+                m_intervals.emplace_hint(it, first, start);
+            }
+            if (last > end) {
+                it = m_intervals.emplace_hint(it, end, last);
+                break;
+            }
+        }
+    }
+
+    void clear() { m_intervals.clear(); }
+
+    bool contains(T value) const {
+        auto it = m_intervals.upper_bound(value);
+        return it != m_intervals.begin() && value < std::prev(it)->second;
+    }
+
+    /// Whether all of [start, end) is in the set.
+    bool covers(T start, T end) const {
+        if (start >= end) {
+            return true;
+        }
+        auto it = m_intervals.upper_bound(start);
+        return it != m_intervals.begin() && end <= std::prev(it)->second;
+    }
+
+    /// Whether any of [start, end) is in the set.
+    bool overlaps(T start, T end) const {
+        if (start >= end) {
+            return false;
+        }
+        auto it = m_intervals.upper_bound(start);
+        if (it != m_intervals.end() && it->first < end) {
+            return true;
+        }
+        return it != m_intervals.begin() && std::prev(it)->second > start;
+    }
+
+    /// Smallest value from `from` on that's not in the set.
+    T firstGap(T from) const {
+        auto it = m_intervals.upper_bound(from);
+        if (it != m_intervals.begin() && std::prev(it)->second > from) {
+            return std::prev(it)->second;
+        }
+        return from;
+    }
+
+    /// Call `fn(gapStart, gapEnd)` for every stretch of [start, end) not in the set, in order.
+    template <typename F>
+    void forEachGap(T start, T end, F&& fn) const {
+        T pos = firstGap(start);
+        auto it = m_intervals.upper_bound(pos);
+        while (pos < end) {
+            if (it == m_intervals.end() || it->first >= end) {
+                fn(pos, end);
+                return;
+            }
+            fn(pos, it->first);
+            pos = it->second;
+            ++it;
+        }
+    }
+
+    /// Call `fn(start, end)` for every interval in the set, in order.
+    template <typename F>
+    void forEach(F&& fn) const {
+        for (const auto& [start, end] : m_intervals) {
+            fn(start, end);
+        }
+    }
+
+    bool empty() const { return m_intervals.empty(); }
+    /// Number of disjoint intervals the set consists of.
+    std::size_t intervals() const { return m_intervals.size(); }
+    /// Number of values in the set.
+    T count() const {
+        T n = 0;
+        for (const auto& [start, end] : m_intervals) {
+            n += end - start;
+        }
+        return n;
+    }
+
+   private:
+    // Start of every interval to its end
+    std::map<T, T> m_intervals;
+};
@@ -0,0 +1,193 @@
+/* clang-format off */
+// Same header ordering issue as in plugin.cpp
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/core.h>
+
+#include "lines.h"
+
+#include "client.h"
+
+#include "plugin.h"
+#include "pluginmain.h"
+
+#include <pluginsdk/_plugins.h>
+#include <pluginsdk/bridgemain.h>
+/* clang-format on */
+
+/// Whether `instr` only pads code, e.g. for alignment, and never corresponds to any source.
+static bool isPadding(const BASIC_INSTRUCTION_INFO &instr) {
+    const std::string mnemonic(instr.instruction, strcspn(instr.instruction, " "));
+    return mnemonic == "int3" || mnemonic == "nop";
+}
+
+/// Same as the above, going by the opcode, so instructions from the graph needn't be disassembled again.
+static bool isPadding(const BridgeCFInstruction &instr) {
+    std::size_t i = 0;
+    // Multi-byte nops may come with operand size prefixes
+    while (i < sizeof(instr.data) - 2 && instr.data[i] == 0x66) {
+        i++;
+    }
+    const unsigned char op = instr.data[i];
+    return op == 0xCC || op == 0x90 || (op == 0x0F && instr.data[i + 1] == 0x1F);
+}
+
+std::vector<std::size_t> instructionStarts(std::size_t start, std::size_t end) {
+    std::vector<std::size_t> addrs = {};
+    duint addr = start;
+    while (addr < end) {
+        BASIC_INSTRUCTION_INFO instr = {};
+        DbgDisasmFastAt(addr, &instr);
+        // Not a valid instruction, resync on the next byte
+        if (instr.size <= 0) {
+            addr++;
+            continue;
+        }
+        if (!isPadding(instr)) {
+            addrs.push_back(addr);
+        }
+        addr += instr.size;
+    }
+    return addrs;
+}
+
+/// Instructions of every basic block of the function, blocks ordered by address.
+static std::vector<std::vector<std::size_t>> basicBlocks(std::size_t start, std::size_t end) {
+    std::vector<std::vector<std::size_t>> blocks = {};
+    BridgeCFGraphList graph = {};
+    if (DbgAnalyzeFunction(start, &graph)) {
+        const auto nodes = static_cast<const BridgeCFNodeList *>(graph.nodes.data);
+        // The analysis disassembled every block already, its instructions are taken as they are
+        std::vector<std::pair<duint, std::vector<std::size_t>>> byStart = {};
+        for (int i = 0; i < graph.nodes.count; i++) {
+            const auto instrs = static_cast<const BridgeCFInstruction *>(nodes[i].instrs.data);
+            std::vector<std::size_t> addrs = {};
+            addrs.reserve(nodes[i].instrs.count);
+            for (int j = 0; j < nodes[i].instrs.count; j++) {
+                if (!isPadding(instrs[j])) {
+                    addrs.push_back(instrs[j].addr);
+                }
+            }
+            if (!addrs.empty()) {
+                byStart.push_back({nodes[i].start, std::move(addrs)});
+            }
+            BridgeList<duint>::Free(&nodes[i].exits);
+            BridgeList<BridgeCFInstruction>::Free(&nodes[i].instrs);
+        }
+        BridgeList<BridgeCFNodeList>::Free(&graph.nodes);
+
+        std::sort(byStart.begin(), byStart.end());
+        for (auto &[blockStart, addrs] : byStart) {
+            blocks.push_back(std::move(addrs));
+        }
+    }
+    if (blocks.empty()) {
+        LOG_DEBUG(pluginLog(), "Failed to analyze function at {:016x}, treating it as a single block", start);
+        auto instrs = instructionStarts(start, end);
+        if (!instrs.empty()) {
+            blocks.push_back(std::move(instrs));
+        }
+    }
+    return blocks;
+}
+
+/// Line of one instruction, as looked up or inferred. -1 if it has none, or looking it up failed.
+struct Mapping {
+    int lineNum;
+    std::string text;
+};
+
+/// Stretch of a block between two looked up instructions, given as indices into the block.
+struct Segment {
+    std::size_t block;
+    std::size_t first;
+    std::size_t last;
+};
+
+std::vector<InstructionLine> mapInstructionLines(std::size_t base, std::size_t start, std::size_t end, Client &c,
+                                                 const CallOptions &opts, LineMappingStats &stats) {
+    const auto blocks = basicBlocks(start, end);
+    std::vector<std::vector<Mapping>> mappings = {};
+    stats = LineMappingStats{blocks.size(), 0, 0, 0};
+    for (const auto &block : blocks) {
+        mappings.emplace_back(block.size(), Mapping{-1, ""});
+        stats.instructions += block.size();
+    }
+
+    // Looks up the given instructions, as (block, index) pairs, all in one batch
+    const auto lookUp = [&](const std::vector<std::pair<std::size_t, std::size_t>> &instrs) {
+        std::vector<std::size_t> offsets = {};
+        offsets.reserve(instrs.size());
+        for (const auto &[b, i] : instrs) {
+            offsets.push_back(blocks[b][i] - base);
+        }
+        const auto results = c.queryDecompiledFunctions(offsets, opts);
+        for (std::size_t k = 0; k < instrs.size(); k++) {
+            const auto &result = results.at(k);
+            Mapping &m = mappings[instrs[k].first][instrs[k].second];
+            if (!result.function) {
+                LOG_WARN(pluginLog(), "Failed to decompile {:016x}: {}", base + result.addr, result.error);
+                continue;
+            }
+            const auto &decomp = *result.function;
+            if (decomp.line_num != -1) {
+                m.lineNum = decomp.line_num;
+                m.text = decomp.source.at(decomp.line_num);
+            }
+        }
+        stats.lookups += instrs.size();
+        stats.rounds++;
+    };
+
+    // Start out knowing both ends of every block
+    std::vector<std::pair<std::size_t, std::size_t>> pending = {};
+    std::vector<Segment> segments = {};
+    for (std::size_t b = 0; b < blocks.size(); b++) {
+        const std::size_t last = blocks[b].size() - 1;
+        pending.push_back({b, 0});
+        if (last > 0) {
+            pending.push_back({b, last});
+            segments.push_back({b, 0, last});
+        }
+    }
+    while (!pending.empty()) {
+        lookUp(pending);
+        pending.clear();
+
+        std::vector<Segment> next = {};
+        for (const auto &s : segments) {
+            if (s.last - s.first <= 1) {
+                continue;
+            }
+            auto &block = mappings[s.block];
+            // Only both ends on the same actual line say anything about what's in between
+            if (block[s.first].lineNum != -1 && block[s.first].lineNum == block[s.last].lineNum) {
+                for (std::size_t i = s.first + 1; i < s.last; i++) {
+                    block[i] = block[s.first];
+                }
+                continue;
+            }
+            // Somewhere in between the line changes, narrow down where
+            const std::size_t mid = s.first + (s.last - s.first) / 2;
+            pending.push_back({s.block, mid});
+            next.push_back({s.block, s.first, mid});
+            next.push_back({s.block, mid, s.last});
+        }
+        segments = std::move(next);
+    }
+
+    std::vector<InstructionLine> lines = {};
+    lines.reserve(stats.instructions);
+    for (std::size_t b = 0; b < blocks.size(); b++) {
+        for (std::size_t i = 0; i < blocks[b].size(); i++) {
+            const Mapping &m = mappings[b][i];
+            lines.push_back(InstructionLine{blocks[b][i], m.lineNum, m.text});
+        }
+    }
+    return lines;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+//! Mapping of instructions to the lines of decompiled source they were compiled from.
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "client.h"
+
+/// An instruction along with the decompiled line it belongs to, if the decompiler knows.
+struct InstructionLine {
+    std::size_t addr;
+    /// -1 if the instruction doesn't map to any line.
+    int lineNum;
+    std::string text;
+};
+
+/// How much work mapping a function took.
+struct LineMappingStats {
+    std::size_t blocks;
+    std::size_t instructions;
+    /// Instructions actually looked up, all others were inferred.
+    std::size_t lookups;
+    /// Batches of lookups sent, each costing a few round trips at most.
+    std::size_t rounds;
+};
+
+/// Addresses of all instructions from `start` up to `end`, as the disassembler sees them, minus padding.
+std::vector<std::size_t> instructionStarts(std::size_t start, std::size_t end);
+
+/// Map every instruction of the function spanning `start` up to `end` to its decompiled line, in address order.
+/// `base` is the module's base address, which the server's addresses are relative to.
+///
+/// Instructions within a basic block almost always map to the same or adjacent lines,
+/// so only the first and last instruction of every block are looked up.
+/// If both map to the same line, so does everything in between.
+/// Otherwise, or if they map to no line at all, the block is bisected until every change of line is pinned down.
+/// Lookups for all blocks go out together, so this costs about log2(longest block) batches.
+/// If x64dbg can't analyze the function, it's treated as a single block.
+std::vector<InstructionLine> mapInstructionLines(std::size_t base, std::size_t start, std::size_t end, Client& c,
+                                                 const CallOptions& opts, LineMappingStats& stats);
@@ -7,6 +7,7 @@
 #include <stdexcept>
 #include <fmt/core.h>
 
+#include "plugin.h"
 #include "pluginmain.h"
 
 #include <pluginsdk/_plugins.h>
@@ -52,7 +53,7 @@ std::vector<Module> getModules() {
 
         m.addr = DbgModBaseFromName(m.name.c_str());
         if (m.addr == 0) {
-            dputs(fmt::format("Failed to get module base from name for {}", m.name).c_str());
+            LOG_WARN(pluginLog(), "Failed to get module base from name for {}", m.name);
             continue;
         }
         modules.push_back(m);
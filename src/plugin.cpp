@@ -1,20 +1,32 @@
 /* clang-format off */
 
 // If these are included after plugin SDK, they cause mysterious compiler errors
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <exception>
 #include <cstdint>
 #include <cstdlib>
+#include <future>
 #include <limits>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <string>
-#include <unordered_set>
+#include <unordered_map>
+#include <vector>
 
 // Same for these headers, as they include them transitively
+#include "capture.h"
 #include "client.h"
 #include <fmt/core.h>
 #include <fmt/ranges.h>
 
 #include "plugin.h"
+#include "decompile_cache.h"
+#include "decompile_queue.h"
+#include "interval_set.h"
+#include "lines.h"
 #include "modules.h"
 #include "types.h"
 
@@ -25,20 +37,67 @@
 
 /* clang-format on */
 
+/// Memory decompiled functions may take up by default, before the least recently used ones are dropped.
+static constexpr std::size_t DECOMPILE_CACHE_BUDGET = 64 * 1024 * 1024;
+
 /// Struct storing global knowledge of the plugin.
 struct Ctx {
-    std::mutex l;        // Lock, as callbacks are concurrent
+    std::mutex l;        // Guards modInfo, as callbacks are concurrent. Never held across calls to the server.
     std::string apiUrl;  // URL of the decompiler XMLRPC server
+    // Long-lived client, so connections to the server are reused between pauses.
+    // Only ever accessed through currentClient(), as it may be swapped out while other threads use it.
+    std::shared_ptr<Client> client;
+    // Guards swapping the client.
+    std::mutex clientLock;
     Module modInfo;      //  Info about the module we care about
-    bool ready;          // Whether we have all the info needed to start working
-    // Addresses we have already decompiled in this session.
-    // Until we find a smarter way to invalidate caches, this should prevent
-    // the worst of redundant work, at the cost of potentially stale source being shown.
-    std::unordered_set<duint> addrsDecompiled;
+    std::atomic<bool> ready;  // Whether we have all the info needed to start working
+    std::atomic<bool> bootstrapQueued;  // Whether getting that info is queued already
+    // Functions decompiled before, so showing them again doesn't involve the server.
+    // Source shown from here may be stale if it was changed in the decompiler in the meantime,
+    // unless the server reports revisions.
+    DecompileCache decompiled{DECOMPILE_CACHE_BUDGET};
+    // Revision of the decompiler's view the cached functions are from, if the server reports revisions
+    std::optional<std::int64_t> cacheRevision;
+    // Guards decompiled and cacheRevision. Only held while touching them, never across calls to the server.
+    std::mutex decompiledLock;
+    // Addresses whose decompiled source is currently shown as comments.
+    // Unlike the cache, only valid as long as the module stays loaded where it is.
+    IntervalSet<duint> shown;
+    // Guards shown. Separate lock, so selecting code in the GUI doesn't wait on looking up the module.
+    std::mutex shownLock;
+    // Runs all decompilations, so callbacks don't wait on the server. Has its own lock.
+    std::unique_ptr<DecompileQueue> queue;
 };
 
+/// Number of symbols applied between progress reports while populating.
+static constexpr std::size_t SYMBOL_PAGE_SIZE = 10000;
+
+/// How long a queued decompilation may take once started before it's given up on.
+static constexpr auto DECOMPILE_TIMEOUT = std::chrono::seconds(30);
+
+/// Number of callers up the call stack prefetched after decompiling where the debuggee paused.
+static constexpr int PREFETCH_CALLERS = 3;
+
 Ctx CTX;
 
+Logger &pluginLog() {
+    static Logger log(LogLevel::Info, [](LogLevel, const std::string &msg) { dputs(msg.c_str()); });
+    return log;
+}
+
+/// The client to talk to the server with.
+/// Stays usable for as long as the caller holds on to it, even if another one is swapped in meanwhile.
+static std::shared_ptr<Client> currentClient() {
+    const auto g = std::lock_guard<std::mutex>(CTX.clientLock);
+    return CTX.client;
+}
+
+/// Have `client` log to the x64dbg log as well, at the plugin's level.
+static void attachClientLog(Client &client) {
+    client.setLogLevel(pluginLog().level());
+    client.setLogSink([](LogLevel, const std::string &msg) { dputs(fmt::format("[Client] {}", msg).c_str()); });
+}
+
 /* String utils which should be part of the goddamn stdlib */
 static std::string removeExtension(const std::string &filename) {
     size_t lastdot = filename.find_last_of(".");
@@ -54,9 +113,46 @@ static bool hasEnding(std::string const &fullString, std::string const &ending)
     }
 }
 
+static double millisSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// Result of a fetch run in the background, along with how long it took.
+template <typename T>
+struct TimedFetch {
+    T value;
+    double millis;
+};
+
+/// Run `fetch` on a thread of its own, so several fetches overlap with each other and with whatever the caller does.
+template <typename F>
+static auto fetchInBackground(F fetch) {
+    using T = decltype(fetch());
+    return std::async(std::launch::async, [fetch]() {
+        const auto start = std::chrono::steady_clock::now();
+        T value = fetch();
+        return TimedFetch<T>{std::move(value), millisSince(start)};
+    });
+}
+
+/// Wait for a background fetch of one kind of types, then add what it got to `types`.
+template <typename T>
+static void collectTypes(std::future<TimedFetch<std::unordered_map<std::string, T>>> &fetch, const char *kind,
+                         std::unordered_map<std::string, Type> &types) {
+    try {
+        const auto fetched = fetch.get();
+        for (const auto &[name, t] : fetched.value) {
+            types.insert({name, Type(t)});
+        }
+        LOG_INFO(pluginLog(), "Fetched {} {} in {:.0f}ms", fetched.value.size(), kind, fetched.millis);
+    } catch (const std::exception &e) {
+        LOG_ERROR(pluginLog(), "Failed to query {} from server: {}", kind, e.what());
+    }
+}
+
 /* Functions for decorating x64dbg output */
 
-static void addSymbol(Symbol s, std::size_t base) {
+static void addSymbol(const Symbol &s, std::size_t base) {
     std::size_t start = base + s.addr;
     std::size_t end = base + s.addr + s.size;
 
@@ -65,13 +161,12 @@ static void addSymbol(Symbol s, std::size_t base) {
             // Clear any previous auto function here from previous runs
             DbgClearAutoFunctionRange(start, end);
             if (!DbgSetAutoFunctionAt(start, end)) {
-                dputs(fmt::format("Failed to add function {} at {:016x}-{:016x}!", s.name, start, end).c_str());
+                LOG_WARN(pluginLog(), "Failed to add function {} at {:016x}-{:016x}!", s.name, start, end);
             }
 
             DbgClearAutoLabelRange(start, end);
             if (!DbgSetAutoLabelAt(start, s.name.c_str())) {
-                dputs(
-                    fmt::format("Failed to set function name for {} at {:016x}-{:016x}!", s.name, start, end).c_str());
+                LOG_WARN(pluginLog(), "Failed to set function name for {} at {:016x}-{:016x}!", s.name, start, end);
             }
             break;
         }
@@ -79,92 +174,131 @@ static void addSymbol(Symbol s, std::size_t base) {
             // TODO: Also use size information
             DbgClearAutoLabelRange(start, end);
             if (!DbgSetAutoLabelAt(start, s.name.c_str())) {
-                dputs(fmt::format("Failed to set label/object name for {} at {:016x}!", s.name, start).c_str());
+                LOG_WARN(pluginLog(), "Failed to set label/object name for {} at {:016x}!", s.name, start);
             }
             break;
         }
     }
 }
 
-static bool addDecompSourceAsComment(std::size_t base, std::size_t funcOffset, Client &c) {
+/// Show the source line of every instruction in the function from `start` to `end` as a comment on it,
+/// replacing whatever was shown before. `lines` has addresses relative to `base`.
+static void showLineComments(duint base, duint start, duint end, const std::vector<InstructionLine> &lines) {
+    DbgClearAutoCommentRange(start, end);
+    std::vector<std::string> lines_seen = {};
+    for (const auto &instr : lines) {
+        if (instr.lineNum != -1) {
+            auto line = fmt::format("DECOMP: {}", instr.text);
+            // Without this, we get multiple comments for the same source line
+            if (lines_seen.size() > 0) {
+                if (line != lines_seen.back()) {
+                    DbgSetAutoCommentAt(base + instr.addr, line.c_str());
+                }
+            } else {
+                DbgSetAutoCommentAt(base + instr.addr, line.c_str());
+            }
+            lines_seen.push_back(line);
+        }
+    }
+}
+
+static bool addDecompSourceAsComment(std::size_t base, std::size_t funcOffset, Client &c, const CallOptions &opts) {
     // Determine bounds of function
     duint start, end;
     if (!DbgFunctionGet(base + funcOffset, &start, &end)) {
-        dputs(fmt::format("Failed to show decompiled function at {:016x}: Failed to get function for address",
-                          base + funcOffset)
-                  .c_str());
+        LOG_WARN(pluginLog(), "Failed to show decompiled function at {:016x}: Failed to get function for address",
+                 base + funcOffset);
         return false;
     }
 
-    dputs(fmt::format("Getting decomp info for function from {:016x} to {:016x}", start, end).c_str());
-
-    // Check whether any part requires re-decompilation
+    LOG_DEBUG(pluginLog(), "Getting decomp info for function from {:016x} to {:016x}", start, end);
 
-    for (duint addr = start; addr < end; addr++) {
-        // Have we already decompiled this address?
-        // If so, it should still be visible, and we should avoid the duplicate work.
-        // TODO: Do this at a less granular (i.e. function level).
-        const bool alreadyDecomped = CTX.addrsDecompiled.find(addr) != CTX.addrsDecompiled.end();
-        if (alreadyDecomped) {
-            // Remove any previous decompiler output for function,
-            // we'll (re-)decompile it
-            DbgClearAutoCommentRange(start, end);
-            break;
+    const std::size_t offset = start - base;
+    std::optional<std::vector<InstructionLine>> cached;
+    {
+        const auto g = std::lock_guard<std::mutex>(CTX.decompiledLock);
+        if (const auto found = CTX.decompiled.find(offset)) {
+            cached = *found;
         }
     }
+    if (cached) {
+        LOG_DEBUG(pluginLog(), "Showing cached decompilation of function at {:016x}", start);
+        showLineComments(base, start, end, *cached);
+        const auto g = std::lock_guard<std::mutex>(CTX.shownLock);
+        // Function ends are inclusive
+        CTX.shown.insert(start, end + 1);
+        return true;
+    }
 
-    // Iterate over all addresses in the function and assign appropriate source to each.
-    // FIXME: This is super inefficient, find a better approach to perform this precise mapping.
-    std::vector<std::string> lines_seen = {};
-    for (duint addr = start; addr < end; addr++) {
-        auto decomp = c.queryDecompiledFunction(addr - base);
-        CTX.addrsDecompiled.insert(addr);
-        if (decomp.line_num != -1) {
-            auto line = fmt::format("DECOMP: {}", decomp.source.at(decomp.line_num));
-            // Without this, we get multiple comments for the same source line
-            if (lines_seen.size() > 0) {
-                if (line != lines_seen.back()) {
-                    DbgSetAutoCommentAt(addr, line.c_str());
-                }
-            } else {
-                DbgSetAutoCommentAt(addr, line.c_str());
-            }
-            lines_seen.push_back(line);
-        }
+    // Find out which source line each instruction in the function belongs to
+    const auto mapStart = std::chrono::steady_clock::now();
+    LineMappingStats stats{};
+    auto lines = mapInstructionLines(base, start, end, c, opts, stats);
+    LOG_DEBUG(pluginLog(),
+              "Mapped {} instructions in {} blocks spanning {} bytes with {} lookups in {} batches in {:.0f}ms",
+              stats.instructions, stats.blocks, end - start, stats.lookups, stats.rounds, millisSince(mapStart));
+
+    for (auto &instr : lines) {
+        instr.addr -= base;
     }
+    showLineComments(base, start, end, lines);
+    {
+        const auto g = std::lock_guard<std::mutex>(CTX.shownLock);
+        CTX.shown.insert(start, end + 1);
+    }
+    const auto g = std::lock_guard<std::mutex>(CTX.decompiledLock);
+    CTX.decompiled.insert(offset, std::move(lines));
     return true;
 }
 
-void decompile(duint addr) {
-    std::lock_guard<std::mutex>(CTX.l);
+/// Whether the decompiled source of `addr` is currently shown.
+static bool isShown(duint addr) {
+    const auto g = std::lock_guard<std::mutex>(CTX.shownLock);
+    return CTX.shown.contains(addr);
+}
 
+void decompile(duint addr, const CallOptions &opts) {
     if (!CTX.ready) {
-        dputs("Plugin not yet ready to handle decompilation. Ignoring.");
+        LOG_DEBUG(pluginLog(), "Plugin not yet ready to handle decompilation. Ignoring.");
         return;
     }
+    // A copy, so the lock isn't held while waiting on the server
+    Module modInfo;
+    {
+        const auto g = std::lock_guard<std::mutex>(CTX.l);
+        modInfo = CTX.modInfo;
+    }
 
     // Is this in the module we care about / have decomp on? Check.
     char modName[MAX_MODULE_SIZE];
     if (!DbgGetModuleAt(addr, modName)) {
-        dputs("Failed to determine which module address belongs to, aborting!");
+        LOG_WARN(pluginLog(), "Failed to determine which module address belongs to, aborting!");
         return;
     }
 
-    std::string trimmedName = removeExtension(CTX.modInfo.name);  // Returned module is without ext
+    std::string trimmedName = removeExtension(modInfo.name);  // Returned module is without ext
     if (std::string(modName) != trimmedName) {
-        dputs(fmt::format("Address belongs to module {}, we only care about {}. Ignoring.", modName, trimmedName)
-                  .c_str());
+        LOG_DEBUG(pluginLog(), "Address belongs to module {}, we only care about {}. Ignoring.", modName, trimmedName);
         return;
     }
 
-    dputs(
-        fmt::format("Fetching decomp for addr {:016x}, base-relative {:016x}", addr, addr - CTX.modInfo.addr).c_str());
+    if (isShown(addr)) {
+        LOG_DEBUG(pluginLog(), "Decompilation of {:016x} already shown. Ignoring.", addr);
+        return;
+    }
+
+    LOG_DEBUG(pluginLog(), "Fetching decomp for addr {:016x}, base-relative {:016x}", addr, addr - modInfo.addr);
     DbgSetAutoCommentAt(addr, "Fetching from decompiler...");
+    const auto client = currentClient();
     try {
-        Client c(CTX.apiUrl.c_str());
-        if (!addDecompSourceAsComment(CTX.modInfo.addr, addr - CTX.modInfo.addr, c)) {
+        if (!addDecompSourceAsComment(modInfo.addr, addr - modInfo.addr, *client, opts)) {
             DbgSetAutoCommentAt(addr, "Decompiler fetch failed, see log!");
         }
+    } catch (const CancelledError &e) {
+        // Nobody is waiting for the result anymore, don't leave a misleading comment behind
+        DbgClearAutoCommentRange(addr, addr + 1);
+        LOG_DEBUG(pluginLog(), "Dropped decompilation of {:016x}: {}", addr, e.what());
+        throw;
     } catch (const std::exception &e) {
         DbgSetAutoCommentAt(addr, "Decompiler fetch failed, see log!");
         throw std::runtime_error(fmt::format("Failed to fetch decompiled source: {}", e.what()));
@@ -172,18 +306,305 @@ void decompile(duint addr) {
     }
 }
 
-void decompileRange(duint start, duint end) {
-    // FIXME: This is obviously a super inefficient way to do it.
-    for (duint addr = start; addr <= end; addr++) {
-        decompile(addr);
+/// Queue decompiling every function overlapping `start` up to and including `end` not already shown,
+/// in address order. Runs as a job of the decompile queue, as large ranges take a while to look through.
+void decompileRange(duint start, duint end, DecompilePriority priority, const CallOptions &opts) {
+    // Functions shown already are skipped whole, only the gaps between them are looked for functions in
+    std::vector<std::pair<duint, duint>> gaps;
+    {
+        const auto g = std::lock_guard<std::mutex>(CTX.shownLock);
+        CTX.shown.forEachGap(start, end + 1,
+                             [&gaps](duint gapStart, duint gapEnd) { gaps.push_back({gapStart, gapEnd}); });
+    }
+    for (const auto &[gapStart, gapEnd] : gaps) {
+        opts.check();
+        // Gaps with no functions at all are common, e.g. padding and data, and skipped without walking them
+        if (!DbgFunctionOverlaps(gapStart, gapEnd - 1)) {
+            continue;
+        }
+        duint addr = gapStart;
+        while (addr < gapEnd) {
+            duint funcStart, funcEnd;
+            if (DbgFunctionGet(addr, &funcStart, &funcEnd)) {
+                CTX.queue->push(funcStart, priority);
+                addr = std::max(addr, funcEnd) + 1;
+                continue;
+            }
+            // Outside of functions there's nothing to decompile, functions only start where instructions do
+            BASIC_INSTRUCTION_INFO instr = {};
+            DbgDisasmFastAt(addr, &instr);
+            // Not a valid instruction, resync on the next byte
+            addr += instr.size > 0 ? instr.size : 1;
+        }
+    }
+}
+
+/// Queue the functions the debuggee returns to from the current one, as the user is likely to step out into them.
+static void prefetchCallers() {
+    DBGCALLSTACK stack = {};
+    DbgFunctions()->GetCallStack(&stack);
+    for (int i = 0; i < std::min(stack.total, PREFETCH_CALLERS); i++) {
+        if (stack.entries[i].to != 0) {
+            CTX.queue->push(stack.entries[i].to, DecompilePriority::Prefetch);
+        }
+    }
+    if (stack.entries != nullptr) {
+        BridgeFree(stack.entries);
+    }
+}
+
+/// Find the module we're targeting, then fetch all debug info for it from the server and apply it.
+/// Runs as a job of the decompile queue, so it's done before any decompilation queued after it.
+static void bootstrap(const CallOptions &opts) {
+    // Module loads from here on queue another attempt if this one fails
+    CTX.bootstrapQueued = false;
+    if (CTX.ready) {
+        return;
+    }
+    // Fetching everything may well take longer than a decompilation is given, only stop if debugging does
+    CallOptions unbounded;
+    unbounded.tokens = opts.tokens;
+
+    const auto client = currentClient();
+    // The server was unreachable last time and hasn't come back yet, check again on the next module load
+    if (!client->serverAvailable()) {
+        return;
+    }
+
+    // TODO: Create config mechanism instead of assuming that main exe is target
+    std::optional<Module> target;
+    for (const auto &mod : getModules()) {
+        if (hasEnding(mod.name, ".exe")) {
+            target = mod;
+        }
+    }
+    if (!target) {
+        return;
+    }
+
+    Client &c = *client;
+    std::optional<std::int64_t> revision;
+    try {
+        c.ping(unbounded);
+        const auto caps = c.capabilities();
+        LOG_INFO(pluginLog(), "Connected to decompiler server {} (protocol {}), multicall: {}, bulk decompile: {}",
+                 caps.version.empty() ? "of unknown version" : caps.version, caps.protocol, caps.multicall,
+                 caps.bulkDecompile);
+        if (caps.revisions) {
+            revision = c.queryRevision(unbounded);
+        }
+    } catch (const CancelledError &) {
+        throw;
+    } catch (const std::exception &e) {
+        LOG_WARN(pluginLog(), "Failed to ping server: {}", e.what());
+        // Try again on the next module load
+        return;
+    }
+
+    {
+        // Only held briefly, everything below runs without it so decompilations aren't held up by waiting on
+        // the server
+        const auto g = std::lock_guard<std::mutex>(CTX.l);
+        CTX.modInfo = *target;
+        // Whatever was shown before belongs to an earlier process, whose module may have been loaded elsewhere
+        const auto gs = std::lock_guard<std::mutex>(CTX.shownLock);
+        CTX.shown.clear();
+        const auto gd = std::lock_guard<std::mutex>(CTX.decompiledLock);
+        // Functions cached in an earlier session only still hold if the decompiler's view hasn't changed since
+        if (!revision || revision != CTX.cacheRevision) {
+            CTX.decompiled.clear();
+        }
+        CTX.cacheRevision = revision;
+        CTX.ready = true;
+    }
+    LOG_INFO(pluginLog(), "Found target module {} at {:016x}", target->name, target->addr);
+
+    const auto base = target->addr;
+    const auto start = std::chrono::steady_clock::now();
+    // Everything but function headers is fetched and decoded in the background, all at once.
+    // Function headers are applied on this thread in the meantime, they're what's most useful the soonest.
+    auto structs = fetchInBackground([&c, &unbounded]() { return c.queryStructs(unbounded); });
+    auto unions = fetchInBackground([&c, &unbounded]() { return c.queryUnions(unbounded); });
+    auto enums = fetchInBackground([&c, &unbounded]() { return c.queryEnums(unbounded); });
+    auto aliases = fetchInBackground([&c, &unbounded]() { return c.queryTypeAliases(unbounded); });
+    auto globals = fetchInBackground([&c, &unbounded]() { return c.queryGlobalVars(unbounded); });
+
+    // Symbols are applied page by page while the rest of the response is still being received,
+    // so even huge binaries never have all of them in memory at once
+    try {
+        LOG_INFO(pluginLog(), "Populating functions...");
+        std::size_t applied = 0;
+        c.forEachFunctionHeader(
+            SYMBOL_PAGE_SIZE,
+            [&applied, base](const std::vector<Symbol> &page) {
+                for (const auto &hdr : page) {
+                    addSymbol(hdr, base);
+                }
+                applied += page.size();
+                LOG_INFO(pluginLog(), "Populated {} functions", applied);
+            },
+            unbounded);
+        LOG_INFO(pluginLog(), "Populated {} functions in {:.0f}ms", applied, millisSince(start));
+    } catch (const CancelledError &) {
+        throw;
+    } catch (const std::exception &e) {
+        LOG_ERROR(pluginLog(), "Failed to query function headers from server: {}", e.what());
+    }
+
+    // Can't just merge() because they need to be converted to the type variant first
+    std::unordered_map<std::string, Type> types{};
+    collectTypes(structs, "structs", types);
+    collectTypes(unions, "unions", types);
+    collectTypes(enums, "enums", types);
+    collectTypes(aliases, "type aliases", types);
+    unbounded.check();
+
+    // Insert types into x64dbg
+    try {
+        LOG_INFO(pluginLog(), "Populating types...");
+        const auto phase = std::chrono::steady_clock::now();
+        if (!addTypes(types)) {
+            LOG_ERROR(pluginLog(), "Failed to populate types!");
+        }
+        LOG_INFO(pluginLog(), "Populated {} types in {:.0f}ms", types.size(), millisSince(phase));
+    } catch (const std::exception &e) {
+        LOG_ERROR(pluginLog(), "Failed to populate types: {}", e.what());
+    }
+
+    try {
+        LOG_INFO(pluginLog(), "Populating globals...");
+        const auto fetched = globals.get();
+        LOG_INFO(pluginLog(), "Fetched {} globals in {:.0f}ms", fetched.value.size(), fetched.millis);
+        const auto phase = std::chrono::steady_clock::now();
+        for (const auto &g : fetched.value) {
+            addSymbol(g, base);
+        }
+        LOG_INFO(pluginLog(), "Populated {} globals in {:.0f}ms", fetched.value.size(), millisSince(phase));
+    } catch (const CancelledError &) {
+        throw;
+    } catch (const std::exception &e) {
+        LOG_ERROR(pluginLog(), "Failed to query globals from server: {}", e.what());
+    }
+    LOG_INFO(pluginLog(), "Done in {:.0f}ms", millisSince(start));
+}
+
+/// Start of the function `addr` is in, if any.
+static std::optional<std::size_t> functionAt(std::size_t addr) {
+    duint start, end;
+    if (!DbgFunctionGet(addr, &start, &end)) {
+        return std::nullopt;
+    }
+    return start;
+}
+
+/// Run a job of the decompile queue, on its worker thread.
+static void runDecompileJob(const DecompileJob &job, const CallOptions &opts) {
+    try {
+        if (job.priority == DecompilePriority::Bootstrap) {
+            bootstrap(opts);
+            return;
+        }
+        if (job.end) {
+            decompileRange(job.addr, *job.end, job.priority, opts);
+            return;
+        }
+        decompile(job.addr, opts);
+    } catch (const CancelledError &) {
+        throw;
+    } catch (const std::exception &e) {
+        LOG_ERROR(pluginLog(), "{}", e.what());
+        return;
+    }
+    if (job.priority == DecompilePriority::Ip) {
+        prefetchCallers();
     }
 }
 
 /* Callbacks */
 
+/// Swap in a client which records all traffic with the server to a capture file,
+/// so the session can be replayed without the server later on.
+static bool startRecording(const std::string &path) {
+    std::shared_ptr<Client> client;
+    try {
+        auto transport = std::make_shared<RecordingTransport>(guardedHttpTransport(CTX.apiUrl), path);
+        client = std::make_shared<Client>(transport);
+        attachClientLog(*client);
+    } catch (const std::exception &e) {
+        LOG_ERROR(pluginLog(), "Failed to start recording: {}", e.what());
+        return false;
+    }
+    // What the server supports is discovered per client, without the handshake the new one would take the slow paths
+    try {
+        client->ping();
+    } catch (const std::exception &e) {
+        LOG_WARN(pluginLog(), "Failed to ping server, recording anyway: {}", e.what());
+    }
+    // Calls still in flight on the old client finish on it, it's destroyed once the last of them is done
+    {
+        const auto g = std::lock_guard<std::mutex>(CTX.clientLock);
+        CTX.client = std::move(client);
+    }
+    LOG_INFO(pluginLog(), "Recording traffic with the server to {}", path);
+    return true;
+}
+
 static bool cbConnectCommand(int argc, char **argv) {
+    if (argc == 3 && std::string(argv[1]) == "record") {
+        return startRecording(argv[2]);
+    }
+    if (argc == 2 && std::string(argv[1]) == "metrics") {
+        LOG_INFO(pluginLog(), "{}", currentClient()->dumpMetrics());
+        const auto queued = CTX.queue->stats();
+        LOG_INFO(pluginLog(),
+                 "Decompile queue: {} pending, {} queued, {} completed, {} superseded, {} covered, {} preempted, "
+                 "{} cancelled",
+                 CTX.queue->pending(), queued.queued, queued.completed, queued.superseded, queued.covered,
+                 queued.preempted, queued.cancelled);
+        const auto g = std::lock_guard<std::mutex>(CTX.decompiledLock);
+        const DecompileCache &cache = CTX.decompiled;
+        LOG_INFO(pluginLog(), "Decompile cache: {} functions, {:.1f} of {:.1f} MiB, {} hits, {} misses, {} evictions",
+                 cache.functions(), cache.bytes() / 1048576.0, cache.budget() / 1048576.0, cache.hits(),
+                 cache.misses(), cache.evictions());
+        return true;
+    }
+    if (argc == 3 && std::string(argv[1]) == "cache") {
+        if (std::string(argv[2]) == "clear") {
+            // Same order as everywhere else, shown before decompiled
+            const auto gs = std::lock_guard<std::mutex>(CTX.shownLock);
+            const auto gd = std::lock_guard<std::mutex>(CTX.decompiledLock);
+            CTX.decompiled.clear();
+            CTX.shown.forEach([](duint start, duint end) { DbgClearAutoCommentRange(start, end - 1); });
+            CTX.shown.clear();
+            return true;
+        }
+        char *rest = nullptr;
+        const unsigned long long mib = strtoull(argv[2], &rest, 10);
+        if (rest == argv[2] || *rest != '\0') {
+            LOG_ERROR(pluginLog(), "Cache size must be a number of MiB, or clear");
+            return false;
+        }
+        const auto g = std::lock_guard<std::mutex>(CTX.decompiledLock);
+        CTX.decompiled.setBudget(static_cast<std::size_t>(mib) * 1024 * 1024);
+        return true;
+    }
+    if (argc == 3 && std::string(argv[1]) == "loglevel") {
+        const auto level = parseLogLevel(argv[2]);
+        if (!level) {
+            LOG_ERROR(pluginLog(), "Unknown log level {}", argv[2]);
+            return false;
+        }
+        pluginLog().setLevel(*level);
+        currentClient()->setLogLevel(*level);
+        return true;
+    }
     if (argc != 5 || std::string(argv[1]) != "connect") {
-        dputs("Usage: " PLUGIN_NAME " connect, host, port");
+        LOG_INFO(pluginLog(),
+                 "Usage: " PLUGIN_NAME " connect, host, port\n"
+                 "       " PLUGIN_NAME " record, path\n"
+                 "       " PLUGIN_NAME " metrics\n"
+                 "       " PLUGIN_NAME " cache, MIB|clear\n"
+                 "       " PLUGIN_NAME " loglevel, trace|debug|info|warn|error|off");
         return false;
     }
 
@@ -193,7 +614,7 @@ static bool cbConnectCommand(int argc, char **argv) {
         int portInt = atoi(argv[3]);
         if (portInt < std::numeric_limits<std::uint16_t>::min() ||
             portInt > std::numeric_limits<std::uint16_t>::max()) {
-            dputs("port out of range!");
+            LOG_ERROR(pluginLog(), "port out of range!");
             return false;
         }
         uint16_t port = static_cast<size_t>(portInt);
@@ -204,97 +625,18 @@ static bool cbConnectCommand(int argc, char **argv) {
 }
 
 static void cbPopulateDebugInfo(CBTYPE type, void *cbInfo) {
-    (void)type;
     (void)cbInfo;
 
-    const auto g = std::lock_guard<std::mutex>(CTX.l);
-
-    // If we haven't figured out where the module we're targeting lives yet,
-    // try doing that (again).
-    // TODO: Create config mechanism instead of assuming that main exe is target
-    if (!CTX.ready) {
-        auto mods = getModules();
-        for (const auto mod : mods) {
-            if (hasEnding(mod.name, ".exe")) {
-                CTX.modInfo = mod;
-                CTX.ready = true;
-                dputs(fmt::format("Found target module {} at {:016x}", mod.name, mod.addr).c_str());
-            }
-        }
-
-        Client c(CTX.apiUrl.c_str());
-        try {
-            c.ping();
-        } catch (const std::exception &e) {
-            dputs(fmt::format("Failed to ping server: {}", e.what()).c_str());
-            return;
-        }
-
-        if (CTX.ready) {
-            // Query type information
-            std::unordered_map<std::string, Type> types{};
-            try {
-                // Now we're at a point where our debug info won't be lost, populate it
-                dputs("Querying structs...");
-                auto structs = c.queryStructs();
-                // Can't just merge() because it needs to be converted to the type variant first
-                for (const auto [name, s] : structs) {
-                    types.insert({name, Type(s)});
-                }
-                // Same for unions
-                dputs("Querying unions...");
-                auto unions = c.queryUnions();
-                for (const auto [name, u] : unions) {
-                    types.insert({name, Type(u)});
-                }
-                // Same for enums
-                dputs("Querying enums...");
-                auto enums = c.queryEnums();
-                for (const auto [name, e] : enums) {
-                    types.insert({name, Type(e)});
-                }
-                // Same for type aliases
-                dputs("Querying type aliases...");
-                auto aliases = c.queryTypeAliases();
-                for (const auto [name, a] : aliases) {
-                    types.insert({name, Type(a)});
-                }
-            } catch (const std::exception &e) {
-                dputs(fmt::format("Failed to query types from server: {}", e.what()).c_str());
-            }
-
-            // Insert types into x64dbg
-            try {
-                dputs("Populating types...");
-                if (!addTypes(types)) {
-                    dputs("Failed to populate types!");
-                }
-            } catch (const std::exception &e) {
-                dputs(fmt::format("Failed to populate types: {}", e.what()).c_str());
-            }
-
-            try {
-                auto hdrs = c.queryFunctionHeaders();
-                dputs("Populating functions...");
-                for (const auto hdr : hdrs) {
-                    addSymbol(hdr, CTX.modInfo.addr);
-                }
-            } catch (const std::exception &e) {
-                dputs(fmt::format("Failed to query function headers from server: {}", e.what()).c_str());
-            }
-
-            try {
-                dputs("Populating globals...");
-                auto globals = c.queryGlobalVars();
-                for (const auto g : globals) {
-                    addSymbol(g, CTX.modInfo.addr);
-                }
-            } catch (const std::exception &e) {
-                dputs(fmt::format("Failed to query globals from server: {}", e.what()).c_str());
-            }
-            dputs("Done");
-        }
+    if (type == CB_CREATEPROCESS) {
+        // Whatever was found before belongs to an earlier process, whose module may have been loaded elsewhere
+        CTX.ready = false;
+        CTX.bootstrapQueued = true;
+    } else if (CTX.ready || CTX.bootstrapQueued.exchange(true)) {
+        // Nothing to do for further modules once set up, or while setting up is still to come
+        return;
     }
+    // Only queue it, setting up takes a round trip per kind of debug info and x64dbg waits for this callback
+    CTX.queue->push(0, DecompilePriority::Bootstrap);
 }
 
 static void cbDecompile(CBTYPE type, void *cbInfo) {
@@ -303,7 +645,7 @@ static void cbDecompile(CBTYPE type, void *cbInfo) {
         // Can obtain IP from context
         PLUG_CB_BREAKPOINT *bp = reinterpret_cast<PLUG_CB_BREAKPOINT *>(cbInfo);
         if (bp == nullptr) {
-            dputs("Breakpoint information structure pointer was null, not executing callback!");
+            LOG_WARN(pluginLog(), "Breakpoint information structure pointer was null, not executing callback!");
             return;
         }
         addr = bp->breakpoint->addr;
@@ -311,18 +653,29 @@ static void cbDecompile(CBTYPE type, void *cbInfo) {
         // Have to obtain IP from register dump
         REGDUMP regs;
         if (!DbgGetRegDumpEx(&regs, sizeof(regs))) {
-            dputs("Failed to get register dump, aborting!");
+            LOG_WARN(pluginLog(), "Failed to get register dump, aborting!");
             return;
         }
 
         addr = static_cast<duint>(regs.regcontext.cip);
     }
-    try {
-        decompile(addr);
-    } catch (const std::exception &e) {
-        dputs(e.what());
-        return;
-    }
+    // Only queue it, x64dbg waits for this callback to return before the UI responds again.
+    // This also supersedes whatever the previous pause asked for.
+    CTX.queue->push(addr, DecompilePriority::Ip);
+}
+
+static void cbStopDebug(CBTYPE type, void *cbInfo) {
+    (void)type;
+    (void)cbInfo;
+
+    CTX.queue->clear();
+    CTX.bootstrapQueued = false;
+    const auto client = currentClient();
+    client->cancelAll();
+    LOG_INFO(pluginLog(), "Debugging stopped, cancelled all pending decompiler requests");
+    const auto stats = client->coalescingStats();
+    LOG_INFO(pluginLog(), "{} decompiler calls made so far, {} shared a round trip with an identical call",
+             stats.calls, stats.coalesced);
 }
 
 /* GUI functionality */
@@ -343,15 +696,12 @@ static void decompileSelection() {
     if (s.start == lastStart && s.end == lastEnd) {
         return;
     }
-    try {
-        decompileRange(s.start, s.end);
-    } catch (const std::exception &e) {
-        dputs(fmt::format("Failed to decompile selection: {}", e.what()).c_str());
-    }
+    // Looking for the functions in the selection is left to the queue as well, so the GUI isn't held up by it.
+    // The view is refreshed once the queue has worked through the selection.
+    CTX.queue->pushRange(s.start, s.end, DecompilePriority::Selection);
 
     lastStart = s.start;
     lastEnd = s.end;
-    GuiUpdateDisassemblyView();
 }
 
 void cbGui(CBTYPE type, void *cbInfo) {
@@ -380,15 +730,27 @@ bool pluginInit(PLUG_INITSTRUCT *initStruct) {
     _plugin_registercallback(pluginHandle, CB_CREATEPROCESS, cbPopulateDebugInfo);
     _plugin_registercallback(pluginHandle, CB_LOADDLL, cbPopulateDebugInfo);
     _plugin_registercallback(pluginHandle, CB_PAUSEDEBUG, cbDecompile);
+    _plugin_registercallback(pluginHandle, CB_STOPDEBUG, cbStopDebug);
     _plugin_registercallback(pluginHandle, CB_WINEVENT, cbGui);
 
     CTX.l.lock();
     // TODO: Read this from config
     CTX.apiUrl = "http://localhost:3662/RPC2/";
+    {
+        const auto g = std::lock_guard<std::mutex>(CTX.clientLock);
+        CTX.client = std::make_shared<Client>(CTX.apiUrl.c_str());
+        attachClientLog(*CTX.client);
+    }
+    CTX.queue = std::make_unique<DecompileQueue>(runDecompileJob, functionAt, GuiUpdateDisassemblyView,
+                                                 DECOMPILE_TIMEOUT);
     CTX.l.unlock();
     return true;
 }
 
-void pluginStop() { dprintf("pluginStop(pluginHandle: %d)\n", pluginHandle); }
+void pluginStop() {
+    dprintf("pluginStop(pluginHandle: %d)\n", pluginHandle);
+    // Join the worker while the plugin is still loaded
+    CTX.queue.reset();
+}
 
 void pluginSetup() { dprintf("pluginSetup(pluginHandle: %d)\n", pluginHandle); }
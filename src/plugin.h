@@ -2,9 +2,13 @@
 
 #include <windows.h>
 
+#include "log.h"
 #include "pluginmain.h"
 
 // functions
 bool pluginInit(PLUG_INITSTRUCT *initStruct);
 void pluginStop();
 void pluginSetup();
+
+/// Logger for everything the plugin prints to the x64dbg log.
+Logger &pluginLog();
@@ -17,6 +17,7 @@
 #include "client.h"
 #include "graph.h"
 
+#include "plugin.h"
 #include "pluginmain.h"
 
 #include <pluginsdk/_plugins.h>
@@ -128,7 +129,7 @@ static std::tuple<std::string, int, bool> parseType(const std::string& declarati
 /// Needed because x64dbg requires types to be defined before they are used.
 static std::vector<Type> sortTypes(const std::unordered_map<std::string, Type>& types) {
     // Create name->ID mapping for more efficient graph operations on integer IDs
-    dputs("Creating type ID mapping...");
+    LOG_DEBUG(pluginLog(), "Creating type ID mapping...");
     std::unordered_map<std::uint32_t, std::string> iDToName{};
     std::unordered_map<std::string, std::uint32_t> nameToID{};
     std::uint32_t id = 0;
@@ -139,7 +140,7 @@ static std::vector<Type> sortTypes(const std::unordered_map<std::string, Type>&
     }
 
     // Populate dependency graph
-    dputs("Creating type dependency graph...");
+    LOG_DEBUG(pluginLog(), "Creating type dependency graph...");
     Graph g{};
     for (const auto& [dependent, type] : types) {
         auto dependentID = nameToID[dependent];
@@ -179,7 +180,7 @@ static std::vector<Type> sortTypes(const std::unordered_map<std::string, Type>&
     }
 
     // Validate acyclicity. For any cycles found, output the cycle to the log and abort.
-    dputs("Validating type dependency graph...");
+    LOG_DEBUG(pluginLog(), "Validating type dependency graph...");
     auto cycles = g.getAllCycles();
     if (!cycles.empty()) {
         for (const auto& cycle : cycles) {
@@ -188,13 +189,13 @@ static std::vector<Type> sortTypes(const std::unordered_map<std::string, Type>&
                 cycleStr += iDToName[v] + " -> ";
             }
             cycleStr += iDToName[cycle[0]];
-            dputs(fmt::format("Cycle detected: {}", cycleStr).c_str());
+            LOG_ERROR(pluginLog(), "Cycle detected: {}", cycleStr);
         }
         throw std::runtime_error("Cycles detected in type dependencies");
     }
 
     // Now run topological sort
-    dputs("Sorting types by dependencies...");
+    LOG_DEBUG(pluginLog(), "Sorting types by dependencies...");
     auto sortedIDs = g.topologicalSort();
 
     // Convert sorted IDs back to types
@@ -219,7 +220,7 @@ static bool addStructure(Structure s) {
         }
     }
     for (const auto& cmd : cmds) {
-        dputs(cmd.c_str());
+        LOG_TRACE(pluginLog(), "{}", cmd);
         if (!DbgCmdExecDirect(cmd.c_str())) {
             return false;
         }
@@ -241,7 +242,7 @@ static bool addUnion(Union u) {
         }
     }
     for (const auto& cmd : cmds) {
-        dputs(cmd.c_str());
+        LOG_TRACE(pluginLog(), "{}", cmd);
         if (!DbgCmdExecDirect(cmd.c_str())) {
             return false;
         }
@@ -282,7 +283,7 @@ bool addTypes(std::unordered_map<std::string, Type> types) {
     auto sortedTypes = sortTypes(types);
     // Debug print to verify sort
     for (const auto& t : sortedTypes) {
-        dputs(std::visit([](const auto& t) { return t.name; }, t).c_str());
+        LOG_TRACE(pluginLog(), "{}", std::visit([](const auto& t) { return t.name; }, t));
     }
 
     // Add types